@@ -0,0 +1,255 @@
+/*
+* throughput of the JUCE free dsp, the numbers behind SDelay::kDefaultTileSize,
+* AllPassBank::kAllPassSectionCost and stack_allpass_detail::NumFusedStack.
+* only meaningful from a release build
+*/
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+#include "fuse_bench.hpp"
+#include "dsp/sdelay.hpp"
+
+namespace {
+constexpr float kSampleRate = 48000.0f;
+// what a host usually hands the plugin
+constexpr int kHostBlock = 512;
+// sections of the kernel tables, a design of about 100 ms
+constexpr size_t kNumSections = 2048;
+
+/**
+ * @return ns per call of f, the best of a few runs of at least 30 ms each
+ */
+template<class Func>
+double MeasureNs(Func&& f) {
+    using Clock = std::chrono::steady_clock;
+    constexpr auto kMinRun = std::chrono::milliseconds{ 30 };
+    auto best = std::numeric_limits<double>::max();
+    for (int run = 0; run < 3; ++run) {
+        int num_calls = 0;
+        const auto begin = Clock::now();
+        auto elapsed = Clock::duration{};
+        do {
+            f();
+            ++num_calls;
+            elapsed = Clock::now() - begin;
+        } while (elapsed < kMinRun);
+        best = std::min(best, std::chrono::duration<double, std::nano>(elapsed).count() / num_calls);
+    }
+    return best;
+}
+
+std::vector<float> Noise(size_t length) {
+    std::mt19937 rng{ 1 };
+    std::uniform_real_distribution<float> u{ -0.5f, 0.5f };
+    std::vector<float> x(length);
+    for (auto& v : x) {
+        v = u(rng);
+    }
+    return x;
+}
+
+template<size_t N>
+struct Stacks {
+    using Filter = StackAllPassFilter<N>;
+    typename Filter::template Arena<Filter> filters;
+    typename Filter::template Arena<typename Filter::State> states;
+
+    explicit Stacks(size_t num_sections) : filters(num_sections / N), states(num_sections / N) {
+        std::mt19937 rng{ 2 };
+        std::uniform_real_distribution<float> u{ 0.0f, 1.0f };
+        for (auto& f : filters) {
+            float theta[N];
+            float radius[N];
+            for (size_t i = 0; i < N; ++i) {
+                theta[i] = u(rng) * 3.0f;
+                radius[i] = 0.5f + 0.49f * u(rng);
+            }
+            f.Set(theta, radius);
+        }
+    }
+
+    // ns per section and sample of a host block run in tiles of the default size
+    template<class BlockProcess>
+    double Measure(BlockProcess&& process) {
+        auto x = Noise(kHostBlock);
+        auto ns = MeasureNs([&] {
+            for (int offset = 0; offset < kHostBlock; offset += SDelay::kDefaultTileSize) {
+                process(x.data() + offset, std::min(SDelay::kDefaultTileSize, kHostBlock - offset));
+            }
+        });
+        return ns / kHostBlock / (filters.size() * N);
+    }
+};
+
+// ---------------------------------------------------------------------------------------------
+
+template<class Arch, size_t N>
+void KernelRow(const char* isa) {
+    using Filter = StackAllPassFilter<N>;
+    Stacks<N> stacks{ kNumSections };
+    auto serial = stacks.Measure([&](float* x, int num) {
+        Filter::template ProcessBlock<Arch>(stacks.filters.data(), stacks.states.data(), stacks.filters.size(), x, num);
+    });
+    auto wavefront = stacks.Measure([&](float* x, int num) {
+        Filter::template ProcessBlockWavefront<Arch>(stacks.filters.data(), stacks.states.data(), stacks.filters.size(), x, num);
+    });
+    std::printf("%-8s %4zu %10.3f %10.3f %8.2fx\n", isa, N, serial, wavefront, serial / wavefront);
+}
+
+template<class Arch>
+void KernelTable(const char* isa) {
+    KernelRow<Arch, 4>(isa);
+    KernelRow<Arch, 8>(isa);
+    KernelRow<Arch, 16>(isa);
+    KernelRow<Arch, 32>(isa);
+}
+
+// ---------------------------------------------------------------------------------------------
+
+template<class Arch, size_t N, size_t kFuse>
+void FuseCell(Stacks<N>& stacks) {
+    using Filter = StackAllPassFilter<N>;
+    if constexpr (N * kFuse <= 32) {
+        auto ns = stacks.Measure([&](float* x, int num) {
+            for (size_t i = 0; i < stacks.filters.size(); i += kFuse) {
+                Filter::template ProcessWavefrontFused<Arch, kFuse>(stacks.filters.data() + i, stacks.states.data() + i, x, num);
+            }
+        });
+        std::printf(" %9.3f%c", ns, GetPluginFuse<Arch, N>() == kFuse ? '*' : ' ');
+    }
+    else {
+        std::printf(" %10s", "-");
+    }
+}
+
+template<class Arch, size_t N>
+void FuseRow(const char* isa) {
+    Stacks<N> stacks{ kNumSections };
+    std::printf("%-8s %4zu", isa, N);
+    FuseCell<Arch, N, 1>(stacks);
+    FuseCell<Arch, N, 2>(stacks);
+    FuseCell<Arch, N, 4>(stacks);
+    FuseCell<Arch, N, 8>(stacks);
+    std::printf("\n");
+}
+
+template<class Arch>
+void FuseTable(const char* isa) {
+    FuseRow<Arch, 4>(isa);
+    FuseRow<Arch, 8>(isa);
+    FuseRow<Arch, 16>(isa);
+    FuseRow<Arch, 32>(isa);
+}
+
+// ---------------------------------------------------------------------------------------------
+
+void Design(DelayDesign& design, float delay_ms) {
+    mana::CurveV2 curve{ 1024, mana::CurveV2::CurveInitEnum::kRamp };
+    design.SetSampleRate(kSampleRate);
+    design.SetMinBw(1.0f);
+    design.SetCurvePitchAxis(*curve.GetSnapshot(), 4096, delay_ms, 0.0f, 1.0f);
+}
+
+// ns per sample of a host block
+double MeasureDelay(SDelay& delay) {
+    auto x = Noise(kHostBlock);
+    return MeasureNs([&] { delay.Process(x.data(), kHostBlock); }) / kHostBlock;
+}
+
+void TileTable() {
+    std::printf("%-10s %8s", "delay ms", "sections");
+    for (int tile : { 8, 16, 32, 64, 128, 256, 512 }) {
+        std::printf(" %9d%c", tile, tile == SDelay::kDefaultTileSize ? '*' : ' ');
+    }
+    std::printf("\n");
+    for (float delay_ms : { 20.0f, 200.0f, 1000.0f }) {
+        DelayDesign design;
+        Design(design, delay_ms);
+        SDelay delay;
+        delay.PrepareProcess(kSampleRate, delay_ms);
+        delay.SetEngine(SDelay::Engine::kAllPass);
+        delay.SetDesign(design);
+        std::printf("%-10.0f %8zu", delay_ms, delay.GetNumFilters());
+        for (int tile : { 8, 16, 32, 64, 128, 256, 512 }) {
+            delay.SetTileSize(tile);
+            std::printf(" %10.1f", MeasureDelay(delay));
+        }
+        std::printf("\n");
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+
+void CrossoverTable() {
+    std::printf("%-10s %8s %8s %10s %10s %8s %8s\n", "delay ms", "sections", "ir", "allpass", "conv", "auto", "cost");
+    for (float delay_ms : { 1.0f, 2.0f, 5.0f, 10.0f, 20.0f, 50.0f, 100.0f, 200.0f, 500.0f }) {
+        DelayDesign design;
+        Design(design, delay_ms);
+        SDelay allpass;
+        SDelay conv;
+        SDelay automatic;
+        for (auto* d : { &allpass, &conv, &automatic }) {
+            d->PrepareProcess(kSampleRate, delay_ms);
+        }
+        allpass.SetEngine(SDelay::Engine::kAllPass);
+        conv.SetEngine(SDelay::Engine::kConvolution);
+        allpass.SetDesign(design);
+        conv.SetDesign(design);
+        automatic.SetDesign(design);
+
+        const auto num_sections = allpass.GetNumFilters();
+        const auto allpass_ns = MeasureDelay(allpass);
+        std::printf("%-10.0f %8zu", delay_ms, num_sections);
+        if (!conv.IsConvolutionActive()) {
+            // the response did not decay within kMaxImpulseResponseMs
+            std::printf(" %8s %10.1f %10s %8s\n", "-", allpass_ns, "-", "allpass");
+            continue;
+        }
+        const auto ir_length = conv.GetBank()->GetConvolution()->length;
+        const auto conv_ns = MeasureDelay(conv);
+        // the flops of a section the convolution estimate would need to call this crossover right
+        const auto section_cost = allpass_ns / num_sections * conv.EstimateConvolutionCost(ir_length) / conv_ns;
+        std::printf(" %8zu %10.1f %10.1f %8s %8.1f\n", ir_length, allpass_ns, conv_ns,
+            automatic.IsConvolutionActive() ? "conv" : "allpass", section_cost);
+    }
+}
+}
+
+int main() {
+    const auto available = xsimd::available_architectures();
+    std::printf("cpu picks %s, host block %d, %zu sections\n\n", GetSimdArchName(), kHostBlock, kNumSections);
+
+    std::printf("ns per section and sample, tile %d\n", SDelay::kDefaultTileSize);
+    std::printf("%-8s %4s %10s %10s %9s\n", "isa", "N", "serial", "wavefront", "speedup");
+    if (available.sse2) {
+        KernelTable<xsimd::sse2>("sse2");
+    }
+    if (available.avx2) {
+        KernelTable<xsimd::avx2>("avx2");
+    }
+    if (available.avx512f) {
+        KernelTable<xsimd::avx512f>("avx512f");
+    }
+
+    std::printf("\nns per section and sample of the wavefront by stacks fused, * is what the plugin builds\n");
+    std::printf("%-8s %4s %10s %10s %10s %10s\n", "isa", "N", "1", "2", "4", "8");
+    if (available.sse2) {
+        FuseTable<xsimd::sse2>("sse2");
+    }
+    if (available.avx2) {
+        FuseTable<xsimd::avx2>("avx2");
+    }
+    if (available.avx512f) {
+        FuseTable<xsimd::avx512f>("avx512f");
+    }
+
+    std::printf("\nns per sample by tile size, * is SDelay::kDefaultTileSize\n");
+    TileTable();
+
+    std::printf("\nns per sample by engine, cost is the kAllPassSectionCost (now %.0f) these timings imply\n",
+        SDelay::kAllPassSectionCost);
+    CrossoverTable();
+    return 0;
+}
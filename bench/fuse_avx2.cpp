@@ -0,0 +1,3 @@
+#include "fuse_kernel.hpp"
+
+FUSE_BENCH_INSTANTIATE(, xsimd::avx2)
\ No newline at end of file
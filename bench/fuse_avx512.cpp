@@ -0,0 +1,3 @@
+#include "fuse_kernel.hpp"
+
+FUSE_BENCH_INSTANTIATE(, xsimd::avx512f)
\ No newline at end of file
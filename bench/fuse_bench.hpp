@@ -0,0 +1,36 @@
+#pragma once
+#include "dsp/stack_allpass.hpp"
+
+/*
+* the fused wavefront at every fuse count that keeps at most 32 filters in one pipeline, compiled
+* once per isa in fuse_<isa>.cpp like the kernels in src/dsp, see fuse_kernel.hpp
+*/
+
+/**
+ * @brief the fuse count the plugin builds, stack_allpass_detail::NumFusedStack
+ */
+template<class Arch, size_t N>
+size_t GetPluginFuse();
+
+#define FUSE_BENCH_INSTANTIATE_FUSE(prefix, arch, n, fuse) \
+    prefix template void StackAllPassFilter<n>::ProcessWavefrontFused<arch, fuse>(const StackAllPassFilter<n>*, StackAllPassFilter<n>::State*, float*, int);
+
+#define FUSE_BENCH_INSTANTIATE(prefix, arch) \
+    prefix template size_t GetPluginFuse<arch, 4>(); \
+    prefix template size_t GetPluginFuse<arch, 8>(); \
+    prefix template size_t GetPluginFuse<arch, 16>(); \
+    prefix template size_t GetPluginFuse<arch, 32>(); \
+    FUSE_BENCH_INSTANTIATE_FUSE(prefix, arch, 4, 1) \
+    FUSE_BENCH_INSTANTIATE_FUSE(prefix, arch, 4, 2) \
+    FUSE_BENCH_INSTANTIATE_FUSE(prefix, arch, 4, 4) \
+    FUSE_BENCH_INSTANTIATE_FUSE(prefix, arch, 4, 8) \
+    FUSE_BENCH_INSTANTIATE_FUSE(prefix, arch, 8, 1) \
+    FUSE_BENCH_INSTANTIATE_FUSE(prefix, arch, 8, 2) \
+    FUSE_BENCH_INSTANTIATE_FUSE(prefix, arch, 8, 4) \
+    FUSE_BENCH_INSTANTIATE_FUSE(prefix, arch, 16, 1) \
+    FUSE_BENCH_INSTANTIATE_FUSE(prefix, arch, 16, 2) \
+    FUSE_BENCH_INSTANTIATE_FUSE(prefix, arch, 32, 1)
+
+FUSE_BENCH_INSTANTIATE(extern, xsimd::sse2)
+FUSE_BENCH_INSTANTIATE(extern, xsimd::avx2)
+FUSE_BENCH_INSTANTIATE(extern, xsimd::avx512f)
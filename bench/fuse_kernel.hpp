@@ -0,0 +1,12 @@
+#pragma once
+#include "dsp/stack_allpass_kernel.hpp"
+#include "fuse_bench.hpp"
+
+/*
+* only include this in the fuse_<isa>.cpp files, see stack_allpass_kernel.hpp
+*/
+
+template<class Arch, size_t N>
+size_t GetPluginFuse() {
+    return stack_allpass_detail::NumFusedStack<Arch, N>();
+}
@@ -1,6 +1,9 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+// largest error of an imported curve, of the delay time
+static constexpr float kImportTolerance = 0.01f;
+
 //==============================================================================
 AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAudioProcessor& p)
     : AudioProcessorEditor (&p), processorRef (p)
@@ -49,6 +52,27 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
         processorRef.curve_->Init(mana::CurveV2::CurveInitEnum::kRamp);
     };
 
+    import_curve_.setButtonText("import");
+    import_curve_.setTooltip("csv of frequency in hz and group delay in ms per row, fitted within 1% of the delay time");
+    import_curve_.onClick = [this] {
+        import_chooser_ = std::make_unique<juce::FileChooser>("import curve", juce::File{}, "*.csv;*.txt");
+        import_chooser_->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
+                                     [this](const juce::FileChooser& chooser) {
+            auto file = chooser.getResult();
+            if (file == juce::File{}) {
+                return;
+            }
+            auto csv = file.loadFileAsString().toStdString();
+            if (!processorRef.ImportCurve(csv, processorRef.delay_time_->get() * kImportTolerance)) {
+                juce::NativeMessageBox::showMessageBoxAsync(
+                    juce::MessageBoxIconType::WarningIcon,
+                    "Error",
+                    "No curve in " + file.getFileName()
+                );
+            }
+        });
+    };
+
     addAndMakeVisible(delay_time_);
     addAndMakeVisible(f_begin_);
     addAndMakeVisible(f_end_);
@@ -61,6 +85,7 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     addAndMakeVisible(res_label_);
     addAndMakeVisible(random_);
     addAndMakeVisible(clear_curve_);
+    addAndMakeVisible(import_curve_);
     addAndMakeVisible(panic_);
 
     setSize (500, 300);
@@ -71,7 +96,7 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     curve_.SetSnapGrid(true);
     curve_.SetGridNum(16, 8);
 
-    group_delay_cache_.resize(256);
+    group_delay_cache_.resize(AudioPluginAudioProcessor::kNumSummaryPoints);
     startTimerHz(10);
 }
 
@@ -145,7 +170,11 @@ void AudioPluginAudioProcessorEditor::resized()
             {
                 auto btn_aera = slider_aera.removeFromRight(80);
                 random_.setBounds(btn_aera.removeFromTop(25));
-                clear_curve_.setBounds(btn_aera.removeFromTop(25));
+                {
+                    auto curve_aera = btn_aera.removeFromTop(25);
+                    clear_curve_.setBounds(curve_aera.removeFromLeft(curve_aera.getWidth() / 2));
+                    import_curve_.setBounds(curve_aera);
+                }
                 panic_.setBounds(btn_aera);
             }
             x_axis_.setBounds(slider_aera.removeFromTop(20));
@@ -157,20 +186,19 @@ void AudioPluginAudioProcessorEditor::resized()
 
 void AudioPluginAudioProcessorEditor::timerCallback()
 {
-    constexpr auto pi = std::numbers::pi_v<float>;
-    auto fs = static_cast<float>(processorRef.getSampleRate());
-
-    group_delay_cache_.clear();
-    auto size = group_delay_cache_.capacity();
-    for (size_t i = 0; i < size; ++i) {
-        auto nor = i / static_cast<float>(size);
-        auto hz = SemitoneMap(nor);
-        auto w = hz / fs * 2 * pi;
-        auto delay_num_samples = processorRef.delays_[0].GetGroupDelay(w);
-        auto delay_num_ms = delay_num_samples * 1000.0f / fs;
-        group_delay_cache_.emplace_back(delay_num_ms);
+    // the design thread evaluates the response, the editor only copies it when a new bank
+    // was published. nothing changed is one atomic load
+    if (processorRef.GetDesignGeneration() == design_generation_) {
+        return;
+    }
+
+    auto summary = processorRef.GetDesignSummary();
+    design_generation_ = summary.generation;
+    if (summary.group_delay_ms.size() == group_delay_cache_.size()) {
+        std::ranges::copy(summary.group_delay_ms, group_delay_cache_.begin());
     }
 
-    num_filter_label_.setText(juce::String{ "n.filters: " } + juce::String(processorRef.delays_[0].GetNumFilters()), juce::dontSendNotification);
-    repaint();
+    num_filter_label_.setText(juce::String{ "n.filters: " } + juce::String(summary.num_filters), juce::dontSendNotification);
+    // the response and the f_begin/f_end lines are drawn over the curve editor only
+    repaint(curve_.getBounds());
 }
@@ -37,9 +37,13 @@ private:
 
     juce::TextButton random_;
     juce::TextButton clear_curve_;
+    juce::TextButton import_curve_;
+    std::unique_ptr<juce::FileChooser> import_chooser_;
     juce::TextButton panic_;
 
     std::vector<float> group_delay_cache_;
+    // of the summary in group_delay_cache_
+    uint64_t design_generation_{};
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginAudioProcessorEditor)
 
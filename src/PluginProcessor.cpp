@@ -6,6 +6,7 @@
 #include <numbers>
 #include <cmath>
 #include "nlohmann/json.hpp"
+#include "dsp/curve_fit.hpp"
 
 constexpr auto kResultsSize = 1024;
 
@@ -90,10 +91,13 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
     value_tree_->addParameterListener("pitch_x", this);
     value_tree_->addParameterListener("min_bw", this);
     value_tree_->addParameterListener("resolution", this);
+
+    design_thread_.startThread();
 }
 
 AudioPluginAudioProcessor::~AudioPluginAudioProcessor()
 {
+    design_thread_.stopThread(10000);
     curve_ = nullptr;
     value_tree_ = nullptr;
 }
@@ -166,10 +170,47 @@ void AudioPluginAudioProcessor::changeProgramName (int index, const juce::String
 //==============================================================================
 void AudioPluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    for (auto& d : delays_) {
-        d.PrepareProcess(sampleRate);
+    const juce::ScopedLock lock{ design_lock_ };
+    // everything a design can need is allocated here, designs while playing only reuse it
+    const auto max_resolution = kResulitionTable[std::size(kResulitionTable) - 1];
+    max_sections_ = DelayDesign::GetMaxNumSections(max_resolution, delay_time_->range.end, static_cast<float>(sampleRate));
+    const auto max_impulse_length = static_cast<size_t>(AllPassBank::kMaxImpulseResponseMs * sampleRate / 1000.0);
+    design_.Reserve(max_resolution, max_sections_);
+    // the summary points, every design from here on is at this rate
+    constexpr auto twopi = std::numbers::pi_v<float> * 2;
+    const auto sample_rate = static_cast<float>(sampleRate);
+    std::vector<float> grid(kNumSummaryPoints);
+    for (int i = 0; i < kNumSummaryPoints; ++i) {
+        grid[i] = SemitoneMap(i / static_cast<float>(kNumSummaryPoints)) / sample_rate * twopi;
     }
-    UpdateFilters();
+    design_.SetSampleRate(sample_rate);
+    design_.SetAnalysisGrid(grid);
+    summary_grid_.SetGrid(grid);
+    summary_delay_.resize(kNumSummaryPoints);
+    // the bulk delay is at most the longest delay_time
+    for (auto& bank : banks_) {
+        for (auto& d : bank.delays) {
+            d.PrepareProcess(static_cast<float>(sampleRate), delay_time_->range.end);
+            d.Reserve(max_sections_, max_impulse_length);
+        }
+        // without lanes this frees their lines
+        const auto num_lanes = UseChannelLanes() ? getTotalNumInputChannels() : 0;
+        bank.lanes.PrepareProcess(static_cast<float>(sampleRate), num_lanes, delay_time_->range.end);
+        if (UseChannelLanes()) {
+            bank.lanes.Reserve(max_sections_);
+        }
+        bank.pool = std::make_shared<AllPassBank>();
+        bank.pool->Reserve(bank.delays[0].GetOptions(), max_sections_, max_impulse_length);
+    }
+
+    // the audio thread is not running, so the first design goes straight into the read slot
+    bank_index_.Reset();
+    auto settings = GetDesignSettings();
+    auto& bank = banks_[bank_index_.GetReadIndex()];
+    unsettled_ = Unsettled{};
+    auto unsettled = DesignBank(bank, *curve_->GetSnapshot(), settings);
+    UpdateSummary(bank, settings);
+    SettleBank(unsettled, bank);
 }
 
 void AudioPluginAudioProcessor::releaseResources()
@@ -184,12 +225,10 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // mono and stereo run one cascade per channel, anything up to 16 channels
+    // (7.1.4, 3rd order ambisonic) goes through the channel lane engine
+    auto num_channels = layouts.getMainOutputChannelSet().size();
+    if (num_channels < 1 || num_channels > static_cast<int>(ChannelLaneAllPass::kMaxChannels))
         return false;
 
     // This checks if the input layout matches the output layout
@@ -212,9 +251,26 @@ void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
     
+    if (auto old = bank_index_.BeginAcquire(); old >= 0) {
+        banks_[bank_index_.GetReadIndex()].TakeStateFrom(banks_[old]);
+        bank_index_.EndAcquire();
+    }
+    auto& bank = banks_[bank_index_.GetReadIndex()];
+    if (panic_flag_.exchange(false)) {
+        for (auto& d : bank.delays) {
+            d.PaincFilterFb();
+        }
+        bank.lanes.PaincFilterFb();
+    }
+
+    if (UseChannelLanes()) {
+        bank.lanes.Process(buffer.getArrayOfWritePointers(), totalNumInputChannels, buffer.getNumSamples());
+        return;
+    }
+
     for (auto i = 0; i < totalNumInputChannels; ++i) {
         auto* channelData = buffer.getWritePointer (i);
-        delays_[i].Process(channelData, buffer.getNumSamples());
+        bank.delays[i].Process(channelData, buffer.getNumSamples());
     }
 }
 
@@ -230,20 +286,45 @@ juce::AudioProcessorEditor* AudioPluginAudioProcessor::createEditor()
 }
 
 //==============================================================================
+// little endian, see BinaryWriter:
+//   u32 magic, u32 version, f32 flat, min_bw, f_begin, f_end, delay_time, u8 pitch_x, i32 resolution index,
+//   the curve (CurveV2::SaveState), u32 size of the BankBlob that follows, 0 without one.
+// states that do not start with the magic are the json text older versions saved
+static constexpr uint32_t kStateMagic = 0x54534453; // "SDST"
+static constexpr uint32_t kStateVersion = 1;
+
 void AudioPluginAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    nlohmann::json j;
-    j["curve"] = curve_->SaveState();
-    j["flat"] = beta_->get();
-    j["min_bw"] = min_bw_->get();
-    j["f_begin"] = f_begin_->get();
-    j["f_end"] = f_end_->get();
-    j["delay_time"] = delay_time_->get();
-    j["pitch_x"] = pitch_x_asix_->get();
-    j["resolution"] = resolution_->getIndex();
+    // the designed bank, so loading the session does not design it again
+    std::shared_ptr<const AllPassBank> bank;
+    uint64_t key{};
+    {
+        const juce::ScopedLock lock{ summary_lock_ };
+        bank = saved_bank_;
+        key = saved_bank_key_;
+    }
+    std::vector<char> blob;
+    if (bank != nullptr) {
+        BankBlob::Write(*bank, key, blob);
+    }
 
-    auto d = j.dump();
-    destData.append(d.data(), d.size());
+    std::vector<char> state;
+    state.reserve(64 + curve_->GetNumPoints() * 16 + blob.size());
+    BinaryWriter writer{ state };
+    writer.Write(kStateMagic);
+    writer.Write(kStateVersion);
+    writer.Write(beta_->get());
+    writer.Write(min_bw_->get());
+    writer.Write(f_begin_->get());
+    writer.Write(f_end_->get());
+    writer.Write(delay_time_->get());
+    writer.Write(pitch_x_asix_->get());
+    writer.Write(static_cast<int32_t>(resolution_->getIndex()));
+    curve_->SaveState(writer);
+    writer.Write(static_cast<uint32_t>(blob.size()));
+    writer.Write(blob.data(), blob.size());
+
+    destData.append(state.data(), state.size());
 }
 
 inline static float GetDefaultValue(juce::AudioParameterFloat* p) {
@@ -256,23 +337,18 @@ inline static float GetDefaultValue(juce::AudioParameterInt* p) {
 
 void AudioPluginAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    std::string d{ reinterpret_cast<const char*>(data), static_cast<size_t>(sizeInBytes) };
     auto bck_vt = value_tree_->copyState();
     try {
-        nlohmann::json j = nlohmann::json::parse(d);
-        update_flag_ = false;
-        curve_->LoadState(j["curve"]);
-        f_begin_->setValueNotifyingHost(f_begin_->convertTo0to1(j.value<float>("f_begin", GetDefaultValue(f_begin_))));
-        min_bw_->setValueNotifyingHost(min_bw_->convertTo0to1(j.value<float>("min_bw", GetDefaultValue(min_bw_))));
-        f_end_->setValueNotifyingHost(f_end_->convertTo0to1(j.value<float>("f_end", GetDefaultValue(f_end_))));
-        delay_time_->setValueNotifyingHost(delay_time_->convertTo0to1(j.value<float>("delay_time", GetDefaultValue(delay_time_))));
-        if (j.contains("pitch_x")) {
-            pitch_x_asix_->setValueNotifyingHost(pitch_x_asix_->convertTo0to1(j.value("pitch-x", true)));
+        // the curve and the parameters land as one design
+        mana::CurveV2::ScopedEdit edit{ *curve_ };
+        BinaryReader reader{ data, static_cast<size_t>(sizeInBytes) };
+        uint32_t magic{};
+        if (reader.Read(magic) && magic == kStateMagic) {
+            LoadBinaryState(reader);
+        }
+        else {
+            LoadJsonState(data, sizeInBytes);
         }
-        resolution_->setValueNotifyingHost(resolution_->convertTo0to1(j.value<int>("resolution", kResulitionNames.indexOf("1024"))));
-        update_flag_ = true;
-        beta_->setValueNotifyingHost(beta_->convertTo0to1(j.value<float>("flat", GetDefaultValue(beta_))));
-        UpdateFilters();
     }
     catch (...) {
         if (auto* ed = getActiveEditor(); ed != nullptr) {
@@ -282,91 +358,402 @@ void AudioPluginAudioProcessor::setStateInformation (const void* data, int sizeI
                 "Error loading state."
             );
         }
+        {
+            const juce::ScopedLock lock{ loaded_bank_lock_ };
+            loaded_bank_ = nullptr;
+        }
         value_tree_->replaceState(bck_vt);
-        update_flag_ = true;
         UpdateFilters();
     }
 }
 
+void AudioPluginAudioProcessor::LoadBinaryState(BinaryReader& reader)
+{
+    uint32_t version{};
+    float flat{};
+    float min_bw{};
+    float f_begin{};
+    float f_end{};
+    float delay_time{};
+    bool pitch_x{};
+    int32_t resolution{};
+    std::vector<mana::CurveV2::Point> points;
+    uint32_t blob_size{};
+    const void* blob{};
+    // the whole state is checked before anything of it is applied. only the version this
+    // writes is known, 0 was never written
+    if (!reader.Read(version) || version != kStateVersion
+        || !reader.Read(flat) || !reader.Read(min_bw) || !reader.Read(f_begin) || !reader.Read(f_end)
+        || !reader.Read(delay_time) || !reader.Read(pitch_x) || !reader.Read(resolution)
+        || !mana::CurveV2::ReadPoints(reader, points)
+        || !reader.Read(blob_size) || (blob = reader.Skip(blob_size)) == nullptr) {
+        throw std::runtime_error{ "damaged state" };
+    }
+    const auto finite = std::ranges::all_of(std::array{ flat, min_bw, f_begin, f_end, delay_time }, [](float v) {
+        return std::isfinite(v);
+    });
+    if (!finite || resolution < 0 || resolution >= static_cast<int32_t>(std::size(kResulitionTable))) {
+        throw std::runtime_error{ "damaged state" };
+    }
+
+    curve_->ReloadPoints(std::move(points));
+    {
+        const juce::ScopedLock lock{ loaded_bank_lock_ };
+        const auto* begin = static_cast<const char*>(blob);
+        loaded_bank_ = blob_size > 0 ? std::make_shared<const std::vector<char>>(begin, begin + blob_size) : nullptr;
+    }
+
+    f_begin_->setValueNotifyingHost(f_begin_->convertTo0to1(f_begin));
+    min_bw_->setValueNotifyingHost(min_bw_->convertTo0to1(min_bw));
+    f_end_->setValueNotifyingHost(f_end_->convertTo0to1(f_end));
+    delay_time_->setValueNotifyingHost(delay_time_->convertTo0to1(delay_time));
+    pitch_x_asix_->setValueNotifyingHost(pitch_x_asix_->convertTo0to1(pitch_x));
+    resolution_->setValueNotifyingHost(resolution_->convertTo0to1(resolution));
+    beta_->setValueNotifyingHost(beta_->convertTo0to1(flat));
+}
+
+void AudioPluginAudioProcessor::LoadJsonState(const void* data, int sizeInBytes)
+{
+    std::string d{ reinterpret_cast<const char*>(data), static_cast<size_t>(sizeInBytes) };
+    nlohmann::json j = nlohmann::json::parse(d);
+    {
+        // the json states never had a bank saved with them
+        const juce::ScopedLock lock{ loaded_bank_lock_ };
+        loaded_bank_ = nullptr;
+    }
+    curve_->LoadState(j["curve"]);
+    f_begin_->setValueNotifyingHost(f_begin_->convertTo0to1(j.value<float>("f_begin", GetDefaultValue(f_begin_))));
+    min_bw_->setValueNotifyingHost(min_bw_->convertTo0to1(j.value<float>("min_bw", GetDefaultValue(min_bw_))));
+    f_end_->setValueNotifyingHost(f_end_->convertTo0to1(j.value<float>("f_end", GetDefaultValue(f_end_))));
+    delay_time_->setValueNotifyingHost(delay_time_->convertTo0to1(j.value<float>("delay_time", GetDefaultValue(delay_time_))));
+    if (j.contains("pitch_x")) {
+        pitch_x_asix_->setValueNotifyingHost(pitch_x_asix_->convertTo0to1(j.value("pitch-x", true)));
+    }
+    resolution_->setValueNotifyingHost(resolution_->convertTo0to1(j.value<int>("resolution", kResulitionNames.indexOf("1024"))));
+    beta_->setValueNotifyingHost(beta_->convertTo0to1(j.value<float>("flat", GetDefaultValue(beta_))));
+}
+
 void AudioPluginAudioProcessor::parameterChanged(const juce::String& parameterID, float newValue)
 {
-    if (!update_flag_) {
-        return;
+    // automation calls this on the audio thread, no lock and no notify here
+    if (!curve_->IsEditing()) {
+        design_pending_.store(true, std::memory_order_release);
     }
+}
 
-    if (parameterID == beta_->getParameterID()) {
-        auto ripple = std::pow(10.0f, beta_->get() / 20.0f);
-        delays_[0].SetBeta(ripple);
-        delays_[1].SetBeta(ripple);
+void AudioPluginAudioProcessor::UpdateFilters()
+{
+    if (!curve_->IsEditing()) {
+        RequestDesign();
     }
-    else if (parameterID == min_bw_->getParameterID()) {
-        auto bw = min_bw_->get();
-        delays_[0].SetMinBw(bw);
-        delays_[1].SetMinBw(bw);
-        UpdateFilters();
+}
+
+void AudioPluginAudioProcessor::RequestDesign()
+{
+    design_pending_.store(true, std::memory_order_release);
+    design_thread_.notify();
+}
+
+AudioPluginAudioProcessor::DesignSettings AudioPluginAudioProcessor::GetDesignSettings() const
+{
+    DesignSettings settings;
+    settings.resolution = kResulitionTable[resolution_->getIndex()];
+    settings.delay_ms = delay_time_->get();
+    settings.f_begin = f_begin_->get();
+    settings.f_end = f_end_->get();
+    if (settings.f_begin > settings.f_end) {
+        std::swap(settings.f_begin, settings.f_end);
+    }
+    settings.pitch_axis = pitch_x_asix_->get();
+    settings.ripple = std::pow(10.0f, beta_->get() / 20.0f);
+    settings.min_bw = min_bw_->get();
+    settings.sample_rate = static_cast<float>(getSampleRate());
+    settings.use_lanes = UseChannelLanes();
+    return settings;
+}
+
+AudioPluginAudioProcessor::Unsettled AudioPluginAudioProcessor::DesignBank(FilterBank& bank, const mana::CurveV2::Snapshot& curve, const DesignSettings& settings)
+{
+    // another instance, or this one earlier, already designed these settings
+    const auto& options = bank.delays[0].GetOptions();
+    const auto key = GetBankKey(curve, settings, options);
+    std::shared_ptr<const AllPassBank> shared = BankCache::Get().Find(key);
+    if (shared == nullptr) {
+        shared = RestoreBank(key, options);
+    }
+    Unsettled unsettled;
+    if (shared == nullptr) {
+        DesignPool(bank, curve, settings);
+        shared = bank.pool;
+        unsettled = Unsettled{ shared, key, design_.IsFullDesign() };
     }
     else {
-        UpdateFilters();
+        const juce::ScopedLock lock{ summary_lock_ };
+        saved_bank_ = shared;
+        saved_bank_key_ = key;
     }
+
+    for (auto& d : bank.delays) {
+        d.SetBank(shared);
+        // the state is taken over from the running bank when it is swapped in
+        d.PaincFilterFb();
+    }
+
+    bank.lanes.PaincFilterFb();
+    if (settings.use_lanes) {
+        bank.lanes.SetFilters(*shared);
+    }
+    return unsettled;
 }
 
-void AudioPluginAudioProcessor::UpdateFilters()
+bool AudioPluginAudioProcessor::SettleBank(const Unsettled& design, FilterBank& bank)
 {
-    if (!update_flag_) {
-        return;
+    if (design.bank == nullptr) {
+        return false;
     }
 
-    const juce::ScopedLock lock{ getCallbackLock() };
+    // the pool is packed again by a later design into its slot, this copy stays
+    auto compact = design.bank->CreateCompact(bank.delays[0].GetOptions());
+    if (design.full) {
+        BankCache::Get().Insert(design.key, compact);
+    }
+    {
+        const juce::ScopedLock lock{ summary_lock_ };
+        saved_bank_ = compact;
+        saved_bank_key_ = design.key;
+    }
 
+    // the lanes run the coefficients either way
+    if (compact->GetConvolution() == nullptr || UseChannelLanes()) {
+        return false;
+    }
+    for (auto& d : bank.delays) {
+        d.SetBank(compact);
+        d.PaincFilterFb();
+    }
+    return true;
+}
+
+std::shared_ptr<const AllPassBank> AudioPluginAudioProcessor::RestoreBank(uint64_t key, const AllPassBank::Options& options)
+{
+    std::shared_ptr<const std::vector<char>> blob;
+    {
+        const juce::ScopedLock lock{ loaded_bank_lock_ };
+        blob = loaded_bank_;
+    }
+    if (blob == nullptr) {
+        return nullptr;
+    }
+
+    // null until the settings and the sample rate are the ones it was saved with
+    auto restored = BankBlob::Read(blob->data(), blob->size(), key, options);
+    if (restored != nullptr) {
+        BankCache::Get().Insert(key, restored);
+        const juce::ScopedLock lock{ loaded_bank_lock_ };
+        if (loaded_bank_ == blob) {
+            loaded_bank_ = nullptr;
+        }
+    }
+    return restored;
+}
+
+void AudioPluginAudioProcessor::DesignPool(FilterBank& bank, const mana::CurveV2::Snapshot& curve, const DesignSettings& settings)
+{
     constexpr auto twopi = std::numbers::pi_v<float> * 2;
-    auto resolution_size = kResulitionTable[resolution_->getIndex()];
-    auto f_begin = f_begin_->get();
-    auto f_end = f_end_->get();
-    if (f_begin > f_end) {
-        std::swap(f_begin, f_end);
+    design_.SetMinBw(settings.min_bw);
+    design_.SetBeta(settings.ripple);
+    auto design = [&](float delay_ms) {
+        if (settings.pitch_axis) {
+            design_.SetCurvePitchAxis(curve, settings.resolution, delay_ms, settings.f_begin, settings.f_end);
+        }
+        else {
+            auto st_begin = SemitoneNor(settings.f_begin);
+            auto st_end = SemitoneNor(settings.f_end);
+            auto freq_begin = Semitone2Hz(st_begin) / settings.sample_rate * twopi;
+            auto freq_end = Semitone2Hz(st_end) / settings.sample_rate * twopi;
+            design_.SetCurve(curve, settings.resolution, delay_ms, freq_begin, freq_end);
+        }
+    };
+    design(settings.delay_ms);
+
+    // more sections than prepareToPlay made room for, the sections follow the delay so it
+    // is scaled down until they fit. the bank drops whatever is still above the pool
+    constexpr int kMaxFitIterations = 4;
+    auto delay_ms = settings.delay_ms;
+    for (int i = 0; i < kMaxFitIterations && design_.GetNumSections() > max_sections_; ++i) {
+        delay_ms *= 0.95f * max_sections_ / design_.GetNumSections();
+        design(delay_ms);
     }
 
-    auto delay = delay_time_->get();
-    if (pitch_x_asix_->get()) {
-        delays_[0].SetCurvePitchAxis(*curve_,resolution_size, delay, f_begin, f_end);
-        delays_[1].SetCurvePitchAxis(*curve_,resolution_size, delay, f_begin, f_end);
+    // packed once into the pool of this slot, no channel runs it while it is the write slot.
+    // every channel runs the same coefficients with its own state. it runs as allpass until
+    // SettleBank, a drag does not render an impulse response for every step
+    if (bank.pool == nullptr) {
+        bank.pool = std::make_shared<AllPassBank>();
     }
-    else {
-        auto st_begin = SemitoneNor(f_begin);
-        auto st_end = SemitoneNor(f_end);
-        auto freq_begin = Semitone2Hz(st_begin) / getSampleRate() * twopi;
-        auto freq_end = Semitone2Hz(st_end) / getSampleRate() * twopi;
-        delays_[0].SetCurve(*curve_, resolution_size, delay, freq_begin, freq_end);
-        delays_[1].SetCurve(*curve_, resolution_size, delay, freq_begin, freq_end);
+    auto options = bank.delays[0].GetOptions();
+    if (options.engine == AllPassBank::Engine::kAuto) {
+        options.engine = AllPassBank::Engine::kAllPass;
+    }
+    bank.pool->Assign(design_, options);
+}
+
+uint64_t AudioPluginAudioProcessor::GetBankKey(const mana::CurveV2::Snapshot& curve, const DesignSettings& settings, const AllPassBank::Options& options) const
+{
+    BankCache::Key key;
+    key.Add(settings.resolution).Add(settings.delay_ms).Add(settings.f_begin).Add(settings.f_end)
+        .Add(settings.pitch_axis).Add(settings.ripple).Add(settings.min_bw).Add(settings.sample_rate);
+    key.Add(options.num_stack).Add(options.engine).Add(options.impulse_threshold).Add(options.convolution_block_size);
+    // the pool bounds the sections
+    key.Add(max_sections_);
+    for (const auto& p : curve.GetAllPoints()) {
+        key.Add(p.x).Add(p.y).Add(p.power).Add(p.power_type);
+    }
+    return key.Get();
+}
+
+void AudioPluginAudioProcessor::UpdateSummary(const FilterBank& bank, const DesignSettings& settings)
+{
+    const auto& delay = bank.delays[0];
+    DesignSummary summary;
+    summary.group_delay_ms.resize(kNumSummaryPoints);
+    summary.num_filters = delay.GetNumFilters();
+    if (delay.GetBank() != bank.pool) {
+        // from the cache or a loaded state, design_ did not see it. the grid is the one of prepareToPlay
+        jassert(summary_grid_.GetNumPoints() == summary_delay_.size());
+        delay.GetBank()->GetGroupDelay(summary_grid_, summary_delay_.data());
+        for (int i = 0; i < kNumSummaryPoints; ++i) {
+            summary.group_delay_ms[i] = static_cast<float>(summary_delay_[i] * 1000.0 / settings.sample_rate);
+        }
+        PublishSummary(std::move(summary));
+        return;
+    }
+
+    // the design keeps the summed group delay of its sections up to date, the bank adds
+    // copies of the last section to fill its last stack and the bulk delay
+    const auto num_sections = design_.GetNumSections();
+    const auto num_padding = delay.GetNumFilters() - num_sections;
+    for (int i = 0; i < kNumSummaryPoints; ++i) {
+        auto delay_num_samples = design_.GetAnalysisGroupDelay(i) + delay.GetBulkDelay();
+        if (num_padding > 0) {
+            delay_num_samples += num_padding * design_.GetSectionGroupDelay(num_sections - 1, design_.GetAnalysisFrequency(i));
+        }
+        summary.group_delay_ms[i] = delay_num_samples * 1000.0f / settings.sample_rate;
+    }
+    PublishSummary(std::move(summary));
+}
+
+void AudioPluginAudioProcessor::PublishSummary(DesignSummary summary)
+{
+    const juce::ScopedLock lock{ summary_lock_ };
+    summary.generation = design_generation_.load(std::memory_order_relaxed) + 1;
+    summary_ = std::move(summary);
+    design_generation_.store(summary_.generation, std::memory_order_release);
+}
+
+AudioPluginAudioProcessor::DesignSummary AudioPluginAudioProcessor::GetDesignSummary() const
+{
+    const juce::ScopedLock lock{ summary_lock_ };
+    return summary_;
+}
+
+// designs start at most this often, the requests in between collapse into the newest one
+static constexpr double kMinDesignIntervalMs = 15.0;
+// a design no other followed for this long is settled
+static constexpr double kSettleMs = 250.0;
+// parameterChanged does not notify, the design thread looks for its changes this often
+static constexpr int kParameterPollMs = 15;
+
+void AudioPluginAudioProcessor::RunDesignThread()
+{
+    auto last_design_ms = 0.0;
+    while (!design_thread_.threadShouldExit()) {
+        // polled rather than woken by the message thread, a host rendering offline may not run it
+        design_thread_.wait(kParameterPollMs);
+        if (!design_pending_.load(std::memory_order_acquire)) {
+            if (juce::Time::getMillisecondCounterHiRes() - last_design_ms >= kSettleMs) {
+                const juce::ScopedLock lock{ design_lock_ };
+                if (SettleBank(unsettled_, banks_[bank_index_.GetWriteIndex()])) {
+                    bank_index_.Publish();
+                }
+                unsettled_ = Unsettled{};
+            }
+            continue;
+        }
+
+        // a drag asks for a design every mouse event, the rest of the burst collapses into one
+        auto wait_ms = kMinDesignIntervalMs - (juce::Time::getMillisecondCounterHiRes() - last_design_ms);
+        while (wait_ms > 0.0 && !design_thread_.threadShouldExit()) {
+            design_thread_.wait(static_cast<int>(std::ceil(wait_ms)));
+            wait_ms = kMinDesignIntervalMs - (juce::Time::getMillisecondCounterHiRes() - last_design_ms);
+        }
+
+        // edits that came in during the last design collapse into the newest one
+        if (!design_pending_.exchange(false, std::memory_order_acquire)) {
+            continue;
+        }
+        last_design_ms = juce::Time::getMillisecondCounterHiRes();
+
+        const juce::ScopedLock lock{ design_lock_ };
+        // before prepareToPlay there is no sample rate, prepareToPlay designs itself
+        if (getSampleRate() <= 0.0) {
+            continue;
+        }
+        // the newest parameters and edit, both keep changing while this designs
+        auto settings = GetDesignSettings();
+        auto curve = curve_->GetSnapshot();
+        auto& bank = banks_[bank_index_.GetWriteIndex()];
+        unsettled_ = DesignBank(bank, *curve, settings);
+        UpdateSummary(bank, settings);
+        bank_index_.Publish();
     }
 }
 
 void AudioPluginAudioProcessor::RandomParameter()
 {
-    update_flag_ = false;
+    mana::CurveV2::ScopedEdit edit{ *curve_ };
     beta_->setValueNotifyingHost(random_.nextFloat());
     min_bw_->setValueNotifyingHost(random_.nextFloat());
     f_begin_->setValueNotifyingHost(random_.nextFloat());
     f_end_->setValueNotifyingHost(random_.nextFloat());
     delay_time_->setValueNotifyingHost(random_.nextFloat());
     pitch_x_asix_->setValueNotifyingHost(random_.nextFloat());
+}
 
-    update_flag_ = true;
-    auto bw = min_bw_->get();
-    delays_[0].SetMinBw(bw);
-    delays_[1].SetMinBw(bw);
-    UpdateFilters();
-    auto ripple = std::pow(10.0f, beta_->get() / 20.0f);
-    delays_[0].SetBeta(ripple);
-    delays_[1].SetBeta(ripple);
+bool AudioPluginAudioProcessor::ImportCurve(std::string_view csv, float tolerance_ms)
+{
+    std::vector<CurveFit::Sample> samples;
+    const auto settings = GetDesignSettings();
+    // GetDesignSettings orders the range, an empty one has no axis to put the rows on
+    if (!CurveFit::ParseCsv(csv, samples) || settings.delay_ms <= 0.0f || !(settings.f_begin < settings.f_end)) {
+        return false;
+    }
+
+    // the same axis DelayDesign samples the curve on
+    const auto hz_begin = SemitoneMap(settings.f_begin);
+    const auto hz_end = SemitoneMap(settings.f_end);
+    for (auto& s : samples) {
+        if (settings.pitch_axis) {
+            s.x = (Hz2Semitone(s.x) - s_st_begin) / (s_st_end - s_st_begin);
+        }
+        else {
+            s.x = (s.x - hz_begin) / (hz_end - hz_begin);
+        }
+        s.y /= settings.delay_ms;
+    }
+    auto points = CurveFit::Fit(std::move(samples), tolerance_ms / settings.delay_ms);
+    if (points.size() < 2) {
+        return false;
+    }
+    mana::CurveV2::ScopedEdit edit{ *curve_ };
+    curve_->ReloadPoints(std::move(points));
+    return true;
 }
 
 void AudioPluginAudioProcessor::PanicFilterFb()
 {
-    const juce::ScopedLock lock{ getCallbackLock() };
-    for (auto& d : delays_) {
-        d.PaincFilterFb();
-    }
+    // cleared by the audio thread at the next block
+    panic_flag_ = true;
 }
 
 void AudioPluginAudioProcessor::OnAddPoint(mana::CurveV2* generator, mana::CurveV2::Point p, int before_idx)
@@ -394,6 +781,16 @@ void AudioPluginAudioProcessor::OnReload(mana::CurveV2* generator)
     UpdateFilters();
 }
 
+void AudioPluginAudioProcessor::OnEditCommit(mana::CurveV2* generator)
+{
+    RequestDesign();
+}
+
+void AudioPluginAudioProcessor::OnEditEnd(mana::CurveV2* generator)
+{
+    RequestDesign();
+}
+
 //==============================================================================
 // This creates new instances of the plugin..
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
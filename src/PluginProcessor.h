@@ -2,8 +2,14 @@
 
 #include <juce_audio_processors/juce_audio_processors.h>
 #include "dsp/sdelay.hpp"
+#include "dsp/channel_lane_allpass.hpp"
+#include "dsp/bank_cache.hpp"
+#include "dsp/bank_blob.hpp"
+#include "dsp/triple_buffer.hpp"
 #include "dsp/curve_v2.h"
 #include <random>
+#include <string_view>
+#include <array>
 
 //==============================================================================
 class AudioPluginAudioProcessor final : public juce::AudioProcessor,
@@ -50,8 +56,28 @@ public:
     //==============================================================================
     void RandomParameter();
     void PanicFilterFb();
+    /**
+     * @brief message thread. replaces the curve with the fewest points that stay within tolerance_ms
+     * @param csv per row x: frequency in hz, y: group delay in ms. x is put on the current axis
+     *        between f_begin and f_end, y is taken relative to delay_time
+     * @param tolerance_ms largest group delay error of any row, in ms
+     * @return false when there is no curve in it or f_begin and f_end are the same frequency
+     */
+    bool ImportCurve(std::string_view csv, float tolerance_ms);
+
+    static constexpr int kNumSummaryPoints = 256;
+    struct DesignSummary {
+        // ms, kNumSummaryPoints over the pitch axis
+        std::vector<float> group_delay_ms;
+        size_t num_filters{};
+        // GetDesignGeneration when it was published
+        uint64_t generation{};
+    };
+    // of the newest design, safe to call from the message thread
+    DesignSummary GetDesignSummary() const;
+    // counts the banks the design thread published, lock free so the editor can poll it
+    uint64_t GetDesignGeneration() const { return design_generation_.load(std::memory_order_acquire); }
 
-    SDelay delays_[2];
     std::unique_ptr<mana::CurveV2> curve_;
     juce::AudioParameterFloat* beta_{};
     juce::AudioParameterFloat* min_bw_{};
@@ -63,7 +89,6 @@ public:
     std::unique_ptr<juce::AudioProcessorValueTreeState> value_tree_;
 
     juce::Random random_;
-    std::atomic_bool update_flag_{ true };
 private:
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginAudioProcessor)
@@ -71,7 +96,110 @@ private:
     // ͨ Listener ̳
     void parameterChanged(const juce::String& parameterID, float newValue) override;
 
+    // throw on damaged data
+    void LoadBinaryState(BinaryReader& reader);
+    // the json text states of older versions
+    void LoadJsonState(const void* data, int sizeInBytes);
+
+    struct FilterBank {
+        // reserved in prepareToPlay and packed again in place by every design into this slot
+        std::shared_ptr<AllPassBank> pool;
+        // every channel runs pool, or the bank BankCache had for the same settings
+        SDelay delays[2];
+        // more than two channels run the same bank as lanes
+        ChannelLaneAllPass lanes;
+
+        void TakeStateFrom(FilterBank& other) {
+            delays[0].TakeStateFrom(other.delays[0]);
+            delays[1].TakeStateFrom(other.delays[1]);
+            lanes.TakeStateFrom(other.lanes);
+        }
+    };
+
+    struct DesignSettings {
+        int resolution{};
+        float delay_ms{};
+        float f_begin{};
+        float f_end{};
+        bool pitch_axis{};
+        float ripple{};
+        float min_bw{};
+        float sample_rate{};
+        bool use_lanes{};
+    };
+
+    // a design of the pool of a bank, neither in BankCache nor saved_bank_ yet
+    struct Unsettled {
+        std::shared_ptr<const AllPassBank> bank;
+        uint64_t key{};
+        // only designs from scratch go into BankCache, see DelayDesign::IsFullDesign
+        bool full{};
+    };
+
+    class DesignThread : public juce::Thread {
+    public:
+        explicit DesignThread(AudioPluginAudioProcessor& p) : juce::Thread("SDelay design"), processor_(p) {}
+        void run() override { processor_.RunDesignThread(); }
+    private:
+        AudioPluginAudioProcessor& processor_;
+    };
+
+    // message thread, the design thread reads the settings and the curve itself.
+    // an open curve edit holds it back until OnEditCommit or OnEditEnd
     void UpdateFilters();
+    void RequestDesign();
+    bool UseChannelLanes() const { return getTotalNumInputChannels() > 2; }
+    DesignSettings GetDesignSettings() const;
+    // everything the bank designed from curve and settings depends on
+    uint64_t GetBankKey(const mana::CurveV2::Snapshot& curve, const DesignSettings& settings, const AllPassBank::Options& options) const;
+    // nothing to settle when the bank came from the cache or a loaded state
+    Unsettled DesignBank(FilterBank& bank, const mana::CurveV2::Snapshot& curve, const DesignSettings& settings);
+    // a design nothing replaced for a while, not every state of a drag: a compact copy of it
+    // is saved with the state and shared through BankCache. true when the copy convolves and
+    // went into bank in place of the allpass pool, the caller publishes it
+    bool SettleBank(const Unsettled& design, FilterBank& bank);
+    // the bank of a loaded state when it was saved under key, also put into the cache
+    std::shared_ptr<const AllPassBank> RestoreBank(uint64_t key, const AllPassBank::Options& options);
+    // designs into design_ and packs it into the pool of the bank
+    void DesignPool(FilterBank& bank, const mana::CurveV2::Snapshot& curve, const DesignSettings& settings);
+    void UpdateSummary(const FilterBank& bank, const DesignSettings& settings);
+    void PublishSummary(DesignSummary summary);
+    void RunDesignThread();
+
+    // designed on the design thread into the write slot, the audio thread swaps to
+    // the newest one at the start of a block without locking
+    std::array<FilterBank, TripleBufferIndex::kNumSlots> banks_;
+    TripleBufferIndex bank_index_;
+    std::atomic_bool panic_flag_{ false };
+
+    // held by the design thread and prepareToPlay, never by the audio thread
+    juce::CriticalSection design_lock_;
+    // shared by every bank, only the part of it a curve edit touches is designed again
+    DelayDesign design_;
+    // sections the pools have room for
+    size_t max_sections_{};
+    // summary points, for banks that come from the cache instead of design_
+    GroupDelayGrid summary_grid_;
+    // samples at every summary point, sized in prepareToPlay
+    std::vector<double> summary_delay_;
+    // newest design of the design thread until it settles, dropped by prepareToPlay
+    Unsettled unsettled_;
+
+    // set by parameterChanged on any thread, also the audio thread, so nothing else happens
+    // there. the design thread polls it
+    std::atomic_bool design_pending_{ false };
+    juce::CriticalSection loaded_bank_lock_;
+    // BankBlob of the last loaded state, kept until a design restores it
+    std::shared_ptr<const std::vector<char>> loaded_bank_;
+
+    mutable juce::CriticalSection summary_lock_;
+    DesignSummary summary_;
+    std::atomic<uint64_t> design_generation_{};
+    // immutable copy of the newest settled bank and its BankCache key, saved with the state
+    std::shared_ptr<const AllPassBank> saved_bank_;
+    uint64_t saved_bank_key_{};
+
+    DesignThread design_thread_{ *this };
 
     // ͨ Listener ̳
     void OnAddPoint(mana::CurveV2* generator, mana::CurveV2::Point p, int before_idx) override;
@@ -79,4 +207,6 @@ private:
     void OnPointXyChanged(mana::CurveV2* generator, int changed_idx) override;
     void OnPointPowerChanged(mana::CurveV2* generator, int changed_idx) override;
     void OnReload(mana::CurveV2* generator) override;
+    void OnEditCommit(mana::CurveV2* generator) override;
+    void OnEditEnd(mana::CurveV2* generator) override;
 };
@@ -0,0 +1,430 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <variant>
+#include <numbers>
+#include <utility>
+#include <tuple>
+#include "stack_allpass.hpp"
+#include "partitioned_convolution.hpp"
+#include "group_delay.hpp"
+#include "delay_design.hpp"
+
+/*
+* the sections of a design packed into stacks, the bulk delay and the rendered impulse
+* response when convolving is cheaper. it does not change while channels run it, so every
+* channel playing the design runs the same one and only keeps its own state.
+* the coefficients the kernels stream are one aligned arena of stacks, theta and radius
+* of every filter are kept apart and only read for analysis and state handover.
+* a bank no running channel sees can be assigned again in place, after Reserve that never allocates
+*/
+class AllPassBank {
+public:
+    template<size_t N>
+    using Filter = StackAllPassFilter<N>;
+    template<size_t N>
+    using Stacks = typename Filter<N>::template Arena<Filter<N>>;
+    static constexpr float kMaxImpulseResponseMs = 2000.0f;
+    static constexpr float kDefaultImpulseThresholdDb = -90.0f;
+    // flops of one allpass section per sample, see PartitionedConvolution::EstimateCost
+    static constexpr float kAllPassSectionCost = 8.0f;
+
+    /*
+    * kAuto renders the designed bank into an impulse response and convolves
+    * when that is estimated to be cheaper than running the sections.
+    * a response that has not decayed within the max length runs as allpass with either
+    */
+    enum class Engine {
+        kAuto,
+        kAllPass,
+        kConvolution
+    };
+
+    struct Options {
+        // filters per stack, 4/8/16/32
+        size_t num_stack{ 8 };
+        Engine engine{ Engine::kAuto };
+        // energy left out when the impulse response is truncated, relative to the energy rendered before it
+        float impulse_threshold{ std::pow(10.0f, kDefaultImpulseThresholdDb / 10.0f) };
+        int convolution_block_size{ PartitionedConvolution::kDefaultBlockSize };
+    };
+
+    /**
+     * @brief not real time safe
+     */
+    static std::shared_ptr<const AllPassBank> Create(const DelayDesign& design, const Options& options) {
+        auto bank = std::make_shared<AllPassBank>();
+        bank->Assign(design, options);
+        return bank;
+    }
+
+    /**
+     * @brief not real time safe. a copy that only runs, for keeping: the coefficients and the
+     *        convolution, without the rendered impulse response, the render scratch and the room of Reserve.
+     *        a bank packed as allpass picks its engine for options here, a design packed with
+     *        Engine::kAllPass while it kept changing is rendered only once it is kept
+     */
+    std::shared_ptr<const AllPassBank> CreateCompact(const Options& options) const {
+        auto bank = std::make_shared<AllPassBank>();
+        std::visit([&bank](const auto& packed) {
+            bank->stacks_.template emplace<std::decay_t<decltype(packed)>>().filters = packed.filters;
+        }, stacks_);
+        bank->theta_ = theta_;
+        bank->radius_ = radius_;
+        bank->num_sections_ = num_sections_;
+        bank->bulk_delay_ = bulk_delay_;
+        bank->sample_rate_ = sample_rate_;
+        bank->impulse_threshold_ = impulse_threshold_;
+        if (use_convolution_) {
+            // a copy of a vector only takes its size, not what was reserved
+            bank->convolution_ = convolution_;
+            bank->use_convolution_ = true;
+            return bank;
+        }
+
+        bank->max_impulse_length_ = max_impulse_length_;
+        bank->SelectEngine(options, sample_rate_);
+        bank->impulse_ = {};
+        std::visit([](auto& packed) { packed.render_states = {}; }, bank->stacks_);
+        return bank;
+    }
+
+    /**
+     * @brief sizes the bank for designs of up to max_sections at options.num_stack
+     * @param max_impulse_length samples, longer responses run as allpass
+     */
+    void Reserve(const Options& options, size_t max_sections, size_t max_impulse_length) {
+        VisitNumStack(options.num_stack, [&]<size_t N>() {
+            auto& packed = Emplace<N>();
+            auto max_stacks = (max_sections + N - 1) / N;
+            packed.filters.reserve(max_stacks);
+            packed.render_states.reserve(max_stacks);
+            theta_.reserve(max_stacks * N);
+            radius_.reserve(max_stacks * N);
+        });
+        max_sections_ = max_sections;
+        InitProbe();
+        impulse_.reserve(max_impulse_length);
+        max_impulse_length_ = max_impulse_length;
+        convolution_.Reserve(max_impulse_length, options.convolution_block_size);
+    }
+
+    /**
+     * @brief packs a design in place. after Reserve the sections above max_sections are dropped
+     */
+    void Assign(const DelayDesign& design, const Options& options) {
+        AssignSections(design.GetNumSections(), [&design](size_t k) {
+            return std::pair{ design.GetCenter(k), design.GetRadius(k) };
+        }, design.GetBulkDelay(), design.GetSampleRate(), options);
+    }
+
+    /**
+     * @brief packs sections another bank was designed with, see GetNumSections
+     * @param bulk_delay samples
+     */
+    void Assign(const float* theta, const float* radius, size_t num_sections, float bulk_delay, float sample_rate, const Options& options) {
+        AssignSections(num_sections, [theta, radius](size_t k) {
+            return std::pair{ theta[k], radius[k] };
+        }, bulk_delay, sample_rate, options);
+    }
+
+    size_t GetNumStack() const {
+        return std::visit([](const auto& packed) {
+            return std::decay_t<decltype(packed.filters)>::value_type::kNumStack;
+        }, stacks_);
+    }
+
+    /**
+     * @return designed sections plus the copies of the last one that fill its stack
+     */
+    size_t GetNumFilters() const {
+        return theta_.size();
+    }
+
+    /**
+     * @return designed sections, the first filters in process order
+     */
+    size_t GetNumSections() const {
+        return num_sections_;
+    }
+
+    template<size_t N>
+    const Stacks<N>& GetFilters() const {
+        return std::get<Packed<N>>(stacks_).filters;
+    }
+
+    /**
+     * @param i filter in process order
+     */
+    float GetTheta(size_t i) const {
+        return theta_[i];
+    }
+
+    float GetRadius(size_t i) const {
+        return radius_[i];
+    }
+
+    float GetSampleRate() const {
+        return sample_rate_;
+    }
+
+    /**
+     * @return samples
+     */
+    float GetBulkDelay() const {
+        return bulk_delay_;
+    }
+
+    /**
+     * @return nullptr when the sections run as allpass, lives as long as the bank
+     */
+    const PartitionedConvolution::Filter* GetConvolution() const {
+        return use_convolution_ ? &convolution_ : nullptr;
+    }
+
+    /**
+     * @brief flops per sample of running the designed sections
+     */
+    float EstimateAllPassCost() const {
+        return GetNumFilters() * kAllPassSectionCost;
+    }
+
+    float GetGroupDelay(float w) const {
+        float delay = 0.0f;
+        for (size_t i = 0; i < theta_.size(); ++i) {
+            delay += AllPassSectionGroupDelay(w, theta_[i], radius_[i]);
+        }
+        return delay + bulk_delay_;
+    }
+
+    /**
+     * @brief group delay of every filter and the bulk delay at all points of the grid in one go
+     * @param out grid.GetNumPoints() samples
+     */
+    void GetGroupDelay(GroupDelayGrid& grid, double* out) const {
+        std::fill(out, out + grid.GetNumPoints(), static_cast<double>(bulk_delay_));
+        grid.Accumulate(theta_.data(), radius_.data(), theta_.size(), out);
+    }
+
+    /**
+     * @brief calls f(a, b) with the coefficients of every designed filter in process order
+     */
+    template<class Func>
+    void ForEachSection(Func&& f) const {
+        std::visit([&](const auto& packed) {
+            for (const auto& stack : packed.filters) {
+                for (size_t j = 0; j < stack.kNumStack; ++j) {
+                    f(stack.GetCoeffA(j), stack.GetCoeffB(j));
+                }
+            }
+        }, stacks_);
+    }
+
+    /**
+     * @brief impulse response of the sections without the bulk delay
+     * @param max_length samples
+     * @return false when it was cut at max_length before it decayed
+     */
+    bool RenderImpulseResponse(std::vector<float>& ir, size_t max_length) const {
+        return std::visit([&](const auto& packed) {
+            auto states = packed.render_states;
+            return Render(packed.filters, states, ir, max_length);
+        }, stacks_);
+    }
+private:
+    template<size_t N>
+    struct Packed {
+        Stacks<N> filters;
+        // scratch for rendering the impulse response
+        typename Filter<N>::template Arena<typename Filter<N>::State> render_states;
+    };
+
+    template<class Func>
+    static void VisitNumStack(size_t num_stack, Func&& f) {
+        switch (num_stack) {
+        case 4:
+            f.template operator()<4>();
+            break;
+        case 16:
+            f.template operator()<16>();
+            break;
+        case 32:
+            f.template operator()<32>();
+            break;
+        default:
+            f.template operator()<8>();
+            break;
+        }
+    }
+
+    template<size_t N>
+    Packed<N>& Emplace() {
+        if (auto* packed = std::get_if<Packed<N>>(&stacks_)) {
+            return *packed;
+        }
+        return stacks_.template emplace<Packed<N>>();
+    }
+
+    void InitProbe() {
+        if (probe_.GetNumPoints() == kNumProbe) {
+            return;
+        }
+        constexpr auto pi = std::numbers::pi_v<float>;
+        std::vector<float> w(kNumProbe);
+        for (size_t i = 0; i < kNumProbe; ++i) {
+            w[i] = pi * (i + 0.5f) / kNumProbe;
+        }
+        probe_.SetGrid(w);
+        probe_delay_.resize(kNumProbe);
+    }
+
+    // false when max_length was reached before the tail fell below impulse_threshold_
+    template<class StackArena, class StateArena>
+    bool Render(const StackArena& filters, StateArena& states, std::vector<float>& ir, size_t max_length) const {
+        using Stack = typename StackArena::value_type;
+        constexpr int kTileSize = 64;
+        // the response is cut when the last tiles together fall below impulse_threshold_ of the energy
+        // before them. relative, the float rounding of the sections keeps the total off unit energy
+        constexpr size_t kNumTailTiles = 16;
+        ir.clear();
+        states.resize(filters.size());
+        for (auto& s : states) {
+            s.PaincFb();
+        }
+        auto process = Stack::SelectBlockProcess(StackSchedule::kWavefront);
+
+        double energy = 0.0;
+        double tail_energy[kNumTailTiles]{};
+        size_t num_tiles = 0;
+        float tile[kTileSize]{};
+        while (ir.size() < max_length) {
+            std::ranges::fill(tile, 0.0f);
+            if (ir.empty()) {
+                tile[0] = 1.0f;
+            }
+            auto num_tile = static_cast<int>(std::min<size_t>(kTileSize, max_length - ir.size()));
+            process(filters.data(), states.data(), filters.size(), tile, num_tile);
+            double tile_energy = 0.0;
+            for (int i = 0; i < num_tile; ++i) {
+                tile_energy += tile[i] * tile[i];
+            }
+            ir.insert(ir.end(), tile, tile + num_tile);
+            energy += tile_energy;
+            tail_energy[num_tiles++ % kNumTailTiles] = tile_energy;
+
+            if (num_tiles < kNumTailTiles || ir.size() == max_length) {
+                continue;
+            }
+            double window = 0.0;
+            for (auto e : tail_energy) {
+                window += e;
+            }
+            if (window <= impulse_threshold_ * (energy - window)) {
+                // the tiles of the window are full ones, they are the part left out
+                ir.resize(ir.size() - kNumTailTiles * kTileSize);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @param section(k) theta and radius of designed section k
+     */
+    template<class Func>
+    void AssignSections(size_t num_sections, Func&& section, float bulk_delay, float sample_rate, const Options& options) {
+        VisitNumStack(options.num_stack, [&]<size_t N>() {
+            Pack<N>(num_sections, section);
+        });
+        bulk_delay_ = bulk_delay;
+        sample_rate_ = sample_rate;
+        impulse_threshold_ = options.impulse_threshold;
+        SelectEngine(options, sample_rate);
+    }
+
+    template<size_t N, class Func>
+    void Pack(size_t num_sections, Func& section) {
+        auto& filters = Emplace<N>().filters;
+        if (max_sections_ > 0) {
+            num_sections = std::min(num_sections, max_sections_);
+        }
+        num_sections_ = num_sections;
+        const auto num_stacks = (num_sections + N - 1) / N;
+        filters.resize(num_stacks);
+        theta_.resize(num_stacks * N);
+        radius_.resize(num_stacks * N);
+        for (size_t i = 0; i < theta_.size(); ++i) {
+            // 复制最后一个滤波器
+            auto k = std::min(i, num_sections - 1);
+            std::tie(theta_[i], radius_[i]) = section(k);
+        }
+        for (size_t i = 0; i < num_stacks; ++i) {
+            filters[i].Set(theta_.data() + i * N, radius_.data() + i * N);
+        }
+    }
+
+    /**
+     * @brief picks the cheaper engine, renders the impulse response when it is convolution
+     */
+    void SelectEngine(const Options& options, float sample_rate) {
+        use_convolution_ = false;
+        if (options.engine == Engine::kAllPass) {
+            return;
+        }
+
+        auto estimate_convolution = [&options](size_t ir_length) {
+            return PartitionedConvolution::EstimateCost(ir_length, options.convolution_block_size);
+        };
+        auto max_length = static_cast<size_t>(kMaxImpulseResponseMs * sample_rate / 1000.0f);
+        if (max_impulse_length_ > 0) {
+            max_length = std::min(max_length, max_impulse_length_);
+        }
+        if (options.engine == Engine::kAuto) {
+            // the response rings out around the largest group delay, it is rendered only if even twice that is cheaper
+            InitProbe();
+            GetGroupDelay(probe_, probe_delay_.data());
+            auto max_delay = std::max(0.0f, static_cast<float>(*std::ranges::max_element(probe_delay_)) - bulk_delay_);
+            auto estimate_length = std::min(max_length, static_cast<size_t>(2.0f * max_delay) + 64);
+            if (estimate_convolution(estimate_length) >= EstimateAllPassCost()) {
+                return;
+            }
+        }
+
+        const auto converged = std::visit([this, max_length](auto& packed) {
+            return Render(packed.filters, packed.render_states, impulse_, max_length);
+        }, stacks_);
+        if (!converged) {
+            return;
+        }
+        if (options.engine == Engine::kAuto && estimate_convolution(impulse_.size()) >= EstimateAllPassCost()) {
+            return;
+        }
+        if (convolution_.block_size != static_cast<size_t>(options.convolution_block_size)) {
+            convolution_.Reserve(impulse_.size(), options.convolution_block_size);
+        }
+        convolution_.Assign(impulse_.data(), impulse_.size());
+        use_convolution_ = true;
+    }
+
+    // hot
+    std::variant<Packed<8>, Packed<4>, Packed<16>, Packed<32>> stacks_;
+    // cold, one per filter in process order
+    std::vector<float> theta_;
+    std::vector<float> radius_;
+    size_t num_sections_{};
+    float bulk_delay_{};
+    float sample_rate_{};
+
+    // 0 until Reserve
+    size_t max_sections_{};
+    size_t max_impulse_length_{};
+
+    static constexpr size_t kNumProbe = 64;
+    GroupDelayGrid probe_;
+    std::vector<double> probe_delay_;
+
+    float impulse_threshold_{};
+    std::vector<float> impulse_;
+    bool use_convolution_{};
+    PartitionedConvolution::Filter convolution_;
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "allpass_bank.hpp"
+#include "bank_cache.hpp"
+#include "binary_io.hpp"
+
+/*
+* the designed sections of a bank saved next to the plugin state, so a session loads without
+* designing again. a bank is only restored under the key it was saved with, that is the same
+* curve, settings and sample rate. little endian:
+*   u32 magic, u32 version, u64 key, f32 sample rate, f32 bulk delay in samples, u32 num sections,
+*   f32 theta[num sections], f32 radius[num sections], u64 fnv-1a of everything before it
+*/
+class BankBlob {
+public:
+    static constexpr uint32_t kMagic = 0x4b424453; // "SDBK"
+    static constexpr uint32_t kVersion = 1;
+
+    /**
+     * @param key BankCache key of the settings the bank was designed with
+     */
+    static void Write(const AllPassBank& bank, uint64_t key, std::vector<char>& out) {
+        const auto begin = out.size();
+        BinaryWriter writer{ out };
+        writer.Write(kMagic);
+        writer.Write(kVersion);
+        writer.Write(key);
+        writer.Write(bank.GetSampleRate());
+        writer.Write(bank.GetBulkDelay());
+        const auto num_sections = bank.GetNumSections();
+        writer.Write(static_cast<uint32_t>(num_sections));
+        for (size_t i = 0; i < num_sections; ++i) {
+            writer.Write(bank.GetTheta(i));
+        }
+        for (size_t i = 0; i < num_sections; ++i) {
+            writer.Write(bank.GetRadius(i));
+        }
+        writer.Write(Checksum(out.data() + begin, out.size() - begin));
+    }
+
+    /**
+     * @brief not real time safe
+     * @return nullptr when the blob is damaged, of another version or was saved under another key
+     */
+    static std::shared_ptr<const AllPassBank> Read(const void* data, size_t size, uint64_t key, const AllPassBank::Options& options) {
+        BinaryReader reader{ data, size };
+        uint32_t magic{};
+        uint32_t version{};
+        uint64_t saved_key{};
+        float sample_rate{};
+        float bulk_delay{};
+        uint32_t num_sections{};
+        if (!reader.Read(magic) || magic != kMagic
+            || !reader.Read(version) || version != kVersion
+            || !reader.Read(saved_key) || saved_key != key
+            || !reader.Read(sample_rate) || !reader.Read(bulk_delay)
+            || !reader.Read(num_sections)
+            || reader.GetRemaining() != (2 * static_cast<size_t>(num_sections)) * sizeof(float) + sizeof(uint64_t)) {
+            return nullptr;
+        }
+
+        std::vector<float> theta(num_sections);
+        std::vector<float> radius(num_sections);
+        reader.Read(theta.data(), num_sections);
+        reader.Read(radius.data(), num_sections);
+        const auto payload = reader.GetPosition();
+        uint64_t checksum{};
+        if (!reader.Read(checksum) || checksum != Checksum(data, payload)) {
+            return nullptr;
+        }
+
+        auto bank = std::make_shared<AllPassBank>();
+        bank->Assign(theta.data(), radius.data(), num_sections, bulk_delay, sample_rate, options);
+        return bank;
+    }
+private:
+    static uint64_t Checksum(const void* data, size_t size) {
+        BankCache::Key hash;
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash.Add(bytes[i]);
+        }
+        return hash.Get();
+    }
+};
@@ -0,0 +1,107 @@
+#pragma once
+#include <list>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+#include "allpass_bank.hpp"
+
+/*
+* banks already designed in this process, keyed by a hash of everything the design depends on.
+* a bank never changes once it is in here, so every instance with the same settings runs the
+* same one. the cache only holds a reference, an evicted bank lives on as long as a channel runs it
+*/
+class BankCache {
+public:
+    static constexpr size_t kDefaultCapacity = 64;
+
+    /*
+    * fnv-1a over the bytes of the values added
+    */
+    class Key {
+    public:
+        template<class T>
+            requires std::is_trivially_copyable_v<T>
+        Key& Add(const T& value) {
+            unsigned char bytes[sizeof(T)];
+            std::memcpy(bytes, &value, sizeof(T));
+            for (auto b : bytes) {
+                hash_ = (hash_ ^ b) * 0x100000001b3ull;
+            }
+            return *this;
+        }
+
+        uint64_t Get() const {
+            return hash_;
+        }
+    private:
+        uint64_t hash_{ 0xcbf29ce484222325ull };
+    };
+
+    /**
+     * @brief the one of the process
+     */
+    static BankCache& Get() {
+        static BankCache cache;
+        return cache;
+    }
+
+    /**
+     * @return nullptr when it was never designed or was evicted
+     */
+    std::shared_ptr<const AllPassBank> Find(uint64_t key) {
+        const std::scoped_lock lock{ lock_ };
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            return nullptr;
+        }
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return it->second->bank;
+    }
+
+    /**
+     * @brief the least recently used entry is dropped when the cache is full
+     */
+    void Insert(uint64_t key, std::shared_ptr<const AllPassBank> bank) {
+        const std::scoped_lock lock{ lock_ };
+        if (auto it = index_.find(key); it != index_.end()) {
+            it->second->bank = std::move(bank);
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return;
+        }
+        entries_.push_front(Entry{ key, std::move(bank) });
+        index_[key] = entries_.begin();
+        Evict();
+    }
+
+    void SetCapacity(size_t capacity) {
+        const std::scoped_lock lock{ lock_ };
+        capacity_ = capacity;
+        Evict();
+    }
+
+    size_t GetSize() const {
+        const std::scoped_lock lock{ lock_ };
+        return entries_.size();
+    }
+private:
+    struct Entry {
+        uint64_t key;
+        std::shared_ptr<const AllPassBank> bank;
+    };
+
+    void Evict() {
+        while (entries_.size() > capacity_) {
+            index_.erase(entries_.back().key);
+            entries_.pop_back();
+        }
+    }
+
+    mutable std::mutex lock_;
+    // most recently used first
+    std::list<Entry> entries_;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+    size_t capacity_{ kDefaultCapacity };
+};
@@ -0,0 +1,163 @@
+#pragma once
+#include <bit>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/*
+* little endian plain values for the saved state, the same bytes on every host.
+* floats are written as their ieee bits, enums as their underlying integer
+*/
+class BinaryWriter {
+public:
+    explicit BinaryWriter(std::vector<char>& out) : out_(out) {}
+
+    template<class T>
+        requires std::is_arithmetic_v<T> || std::is_enum_v<T>
+    void Write(T value) {
+        if constexpr (std::is_enum_v<T>) {
+            Write(static_cast<std::underlying_type_t<T>>(value));
+        }
+        else if constexpr (std::is_same_v<T, bool>) {
+            Write(static_cast<uint8_t>(value));
+        }
+        else if constexpr (std::is_same_v<T, float>) {
+            Write(std::bit_cast<uint32_t>(value));
+        }
+        else if constexpr (std::is_same_v<T, double>) {
+            Write(std::bit_cast<uint64_t>(value));
+        }
+        else {
+            auto bits = static_cast<std::make_unsigned_t<T>>(value);
+            for (size_t i = 0; i < sizeof(T); ++i) {
+                out_.push_back(static_cast<char>((bits >> (8 * i)) & 0xff));
+            }
+        }
+    }
+
+    void Write(const float* values, size_t num) {
+        if constexpr (std::endian::native == std::endian::little) {
+            auto begin = reinterpret_cast<const char*>(values);
+            out_.insert(out_.end(), begin, begin + num * sizeof(float));
+        }
+        else {
+            for (size_t i = 0; i < num; ++i) {
+                Write(values[i]);
+            }
+        }
+    }
+
+    /**
+     * @brief raw bytes
+     */
+    void Write(const void* data, size_t size) {
+        auto begin = static_cast<const char*>(data);
+        out_.insert(out_.end(), begin, begin + size);
+    }
+
+    size_t GetSize() const {
+        return out_.size();
+    }
+private:
+    std::vector<char>& out_;
+};
+
+/*
+* reads what BinaryWriter wrote, every read checks the size and returns false past the end
+*/
+class BinaryReader {
+public:
+    BinaryReader(const void* data, size_t size)
+        : data_(static_cast<const unsigned char*>(data)), size_(size) {}
+
+    template<class T>
+        requires std::is_arithmetic_v<T> || std::is_enum_v<T>
+    bool Read(T& value) {
+        if constexpr (std::is_enum_v<T>) {
+            std::underlying_type_t<T> raw{};
+            if (!Read(raw)) {
+                return false;
+            }
+            value = static_cast<T>(raw);
+            return true;
+        }
+        else if constexpr (std::is_same_v<T, bool>) {
+            uint8_t raw{};
+            if (!Read(raw)) {
+                return false;
+            }
+            value = raw != 0;
+            return true;
+        }
+        else if constexpr (std::is_same_v<T, float>) {
+            uint32_t raw{};
+            if (!Read(raw)) {
+                return false;
+            }
+            value = std::bit_cast<float>(raw);
+            return true;
+        }
+        else if constexpr (std::is_same_v<T, double>) {
+            uint64_t raw{};
+            if (!Read(raw)) {
+                return false;
+            }
+            value = std::bit_cast<double>(raw);
+            return true;
+        }
+        else {
+            if (GetRemaining() < sizeof(T)) {
+                return false;
+            }
+            std::make_unsigned_t<T> bits{};
+            for (size_t i = 0; i < sizeof(T); ++i) {
+                bits |= static_cast<std::make_unsigned_t<T>>(data_[pos_ + i]) << (8 * i);
+            }
+            pos_ += sizeof(T);
+            value = static_cast<T>(bits);
+            return true;
+        }
+    }
+
+    bool Read(float* values, size_t num) {
+        if (GetRemaining() / sizeof(float) < num) {
+            return false;
+        }
+        if constexpr (std::endian::native == std::endian::little) {
+            std::memcpy(values, data_ + pos_, num * sizeof(float));
+            pos_ += num * sizeof(float);
+        }
+        else {
+            for (size_t i = 0; i < num; ++i) {
+                Read(values[i]);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief skips size bytes
+     * @return the skipped bytes, nullptr past the end
+     */
+    const void* Skip(size_t size) {
+        if (GetRemaining() < size) {
+            return nullptr;
+        }
+        auto* begin = data_ + pos_;
+        pos_ += size;
+        return begin;
+    }
+
+    size_t GetPosition() const {
+        return pos_;
+    }
+
+    size_t GetRemaining() const {
+        return size_ - pos_;
+    }
+private:
+    const unsigned char* data_;
+    size_t size_;
+    size_t pos_{};
+};
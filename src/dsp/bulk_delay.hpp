@@ -0,0 +1,91 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+/*
+* integer delay line followed by a first order thiran allpass for the fraction.
+* carries the constant part of the delay curve so the allpass bank only builds the rest
+*/
+class BulkDelay {
+public:
+    void Init(size_t max_delay_samples) {
+        size_t size = 1;
+        while (size < max_delay_samples + 2) {
+            size <<= 1;
+        }
+        buffer_.assign(size, 0.0f);
+        mask_ = size - 1;
+        write_pos_ = 0;
+        SetDelay(std::min(delay_, static_cast<float>(max_delay_samples)));
+    }
+
+    /**
+     * @brief below half a sample the line is bypassed
+     * @param delay_samples 0 or 0.5~max_delay_samples
+     */
+    void SetDelay(float delay_samples) {
+        if (delay_samples < 0.5f || buffer_.empty()) {
+            delay_ = 0.0f;
+            integer_ = 0;
+            eta_ = 0.0f;
+            return;
+        }
+
+        // keep the fraction in 0.5~1.5, where the thiran allpass is accurate and stable
+        delay_samples = std::min(delay_samples, static_cast<float>(mask_ - 1));
+        delay_ = delay_samples;
+        integer_ = static_cast<size_t>(std::floor(delay_samples - 0.5f));
+        auto frac = delay_samples - integer_;
+        eta_ = (1.0f - frac) / (1.0f + frac);
+    }
+
+    float GetDelay() const {
+        return delay_;
+    }
+
+    void Process(float* input, int num_samples) {
+        if (delay_ == 0.0f) {
+            return;
+        }
+
+        for (int n = 0; n < num_samples; ++n) {
+            buffer_[write_pos_] = input[n];
+            auto x = buffer_[(write_pos_ - integer_) & mask_];
+            write_pos_ = (write_pos_ + 1) & mask_;
+
+            auto y = eta_ * (x - y1_) + x1_;
+            x1_ = x;
+            y1_ = y;
+            input[n] = y;
+        }
+    }
+
+    /**
+     * @brief exchange the running line with another one of the same size, the delay settings stay
+     */
+    void SwapLine(BulkDelay& other) {
+        if (mask_ != other.mask_) {
+            return;
+        }
+        std::swap(buffer_, other.buffer_);
+        std::swap(write_pos_, other.write_pos_);
+        std::swap(x1_, other.x1_);
+        std::swap(y1_, other.y1_);
+    }
+
+    void Reset() {
+        std::ranges::fill(buffer_, 0.0f);
+        x1_ = 0.0f;
+        y1_ = 0.0f;
+    }
+private:
+    std::vector<float> buffer_;
+    size_t mask_{};
+    size_t write_pos_{};
+    size_t integer_{};
+    float delay_{};
+    float eta_{};
+    float x1_{};
+    float y1_{};
+};
@@ -0,0 +1,150 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <xsimd/xsimd.hpp>
+#include "simd_arch.hpp"
+#include "sdelay.hpp"
+
+/*
+* runs the filters of one AllPassBank on many channels at once.
+* every simd lane is one channel and the coefficients are broadcast, so the recursion
+* of each lane is independent instead of chained through the stack.
+*/
+class ChannelLaneAllPass {
+public:
+    static constexpr size_t kMaxChannels = 16;
+    // x1, x2, y1, y2 of every channel for one filter
+    static constexpr size_t kStateStride = 4 * kMaxChannels;
+    static constexpr int kDefaultTileSize = 64;
+
+    struct Block {
+        const float* a;
+        const float* b;
+        float* state;
+        size_t num_filters;
+        float* const* channels;
+        int num_channels;
+        int num_samples;
+        float* scratch;
+    };
+    using BlockProcessFn = void(*)(const Block& block);
+
+    /**
+     * @brief kernels are compiled once per ISA in channel_lane_<isa>.cpp
+     *        see channel_lane_kernel.hpp
+     */
+    template<class Arch>
+    static void ProcessBlock(const Block& block);
+
+    /**
+     * @param num_channels channels that get a bulk delay line, the lines of the others are freed
+     * @param max_bulk_delay_ms longest bulk delay of the banks it will run
+     */
+    void PrepareProcess(float sample_rate, int num_channels, float max_bulk_delay_ms = SDelay::kMaxBulkDelayMs) {
+        scratch_.resize(kMaxChannels * tile_size_);
+        max_bulk_delay_ms = std::min(max_bulk_delay_ms, SDelay::kMaxBulkDelayMs);
+        const auto max_delay_samples = static_cast<size_t>(std::ceil(max_bulk_delay_ms * sample_rate / 1000.0f));
+        for (int c = 0; c < static_cast<int>(kMaxChannels); ++c) {
+            if (c < num_channels) {
+                bulk_delay_[c].Init(max_delay_samples);
+            }
+            else {
+                bulk_delay_[c] = BulkDelay{};
+            }
+        }
+        process_ = xsimd::dispatch<SimdArchList>([]<class Arch>(Arch) -> BlockProcessFn {
+            return &ChannelLaneAllPass::ProcessBlock<Arch>;
+        })();
+    }
+
+    /**
+     * @brief samples of every channel pushed through all filters at once, small enough to stay in L1
+     */
+    void SetTileSize(int tile_size) {
+        tile_size_ = std::max(1, tile_size);
+        scratch_.resize(kMaxChannels * tile_size_);
+    }
+
+    /**
+     * @brief after this SetFilters with banks of up to max_sections does not allocate
+     */
+    void Reserve(size_t max_sections) {
+        // the last stack is filled with copies
+        max_sections += SDelay::kMaxNumStack;
+        a_.reserve(max_sections);
+        b_.reserve(max_sections);
+        state_.reserve(max_sections * kStateStride);
+    }
+
+    /**
+     * @brief copy the coefficients and the bulk delay of a bank into the broadcast layout, the state of filters that still exist is kept
+     */
+    void SetFilters(const AllPassBank& bank) {
+        a_.clear();
+        b_.clear();
+        bank.ForEachSection([this](float a, float b) {
+            a_.push_back(a);
+            b_.push_back(b);
+        });
+        state_.resize(a_.size() * kStateStride);
+        for (auto& d : bulk_delay_) {
+            d.SetDelay(bank.GetBulkDelay());
+        }
+    }
+
+    void Process(float* const* channels, int num_channels, int num_samples) {
+        if (process_ == nullptr) {
+            return;
+        }
+
+        num_channels = std::min(num_channels, static_cast<int>(kMaxChannels));
+        float* chunk[kMaxChannels]{};
+        for (int offset = 0; offset < num_samples; offset += tile_size_) {
+            for (int c = 0; c < num_channels; ++c) {
+                chunk[c] = channels[c] + offset;
+            }
+            process_(Block{
+                a_.data(), b_.data(), state_.data(), a_.size(),
+                chunk, num_channels, std::min(tile_size_, num_samples - offset),
+                scratch_.data()
+            });
+        }
+        for (int c = 0; c < num_channels; ++c) {
+            bulk_delay_[c].Process(channels[c], num_samples);
+        }
+    }
+
+    /**
+     * @brief take over the running state of the lanes this one replaces, no allocation
+     */
+    void TakeStateFrom(ChannelLaneAllPass& other) {
+        auto num = std::min(state_.size(), other.state_.size());
+        std::copy(other.state_.begin(), other.state_.begin() + num, state_.begin());
+        for (size_t c = 0; c < kMaxChannels; ++c) {
+            bulk_delay_[c].SwapLine(other.bulk_delay_[c]);
+        }
+    }
+
+    void PaincFilterFb() {
+        std::ranges::fill(state_, 0.0f);
+        for (auto& d : bulk_delay_) {
+            d.Reset();
+        }
+    }
+
+    size_t GetNumFilters() const {
+        return a_.size();
+    }
+private:
+    std::vector<float> a_;
+    std::vector<float> b_;
+    std::vector<float, xsimd::aligned_allocator<float, 64>> state_;
+    std::vector<float, xsimd::aligned_allocator<float, 64>> scratch_;
+    BulkDelay bulk_delay_[kMaxChannels];
+    BlockProcessFn process_{};
+    int tile_size_{ kDefaultTileSize };
+};
+
+extern template void ChannelLaneAllPass::ProcessBlock<xsimd::sse2>(const Block&);
+extern template void ChannelLaneAllPass::ProcessBlock<xsimd::avx2>(const Block&);
+extern template void ChannelLaneAllPass::ProcessBlock<xsimd::avx512f>(const Block&);
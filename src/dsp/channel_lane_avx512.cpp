@@ -0,0 +1,3 @@
+#include "channel_lane_kernel.hpp"
+
+template void ChannelLaneAllPass::ProcessBlock<xsimd::avx512f>(const Block&);
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+#include "channel_lane_allpass.hpp"
+
+/*
+* only include this in the channel_lane_<isa>.cpp files, same rules as stack_allpass_kernel.hpp
+*/
+
+template<class Arch>
+void ChannelLaneAllPass::ProcessBlock(const Block& block) {
+    using batch = xsimd::batch<float, Arch>;
+    constexpr int kLanes = static_cast<int>(batch::size);
+    constexpr size_t kX1 = 0;
+    constexpr size_t kX2 = kMaxChannels;
+    constexpr size_t kY1 = 2 * kMaxChannels;
+    constexpr size_t kY2 = 3 * kMaxChannels;
+
+    float* frames = block.scratch;
+    for (int group = 0; group < block.num_channels; group += kLanes) {
+        const int num_lanes = block.num_channels - group < kLanes ? block.num_channels - group : kLanes;
+
+        // interleave, unused lanes run on silence
+        for (int n = 0; n < block.num_samples; ++n) {
+            float* frame = frames + n * kLanes;
+            for (int c = 0; c < kLanes; ++c) {
+                frame[c] = c < num_lanes ? block.channels[group + c][n] : 0.0f;
+            }
+        }
+
+        for (size_t i = 0; i < block.num_filters; ++i) {
+            float* state = block.state + i * kStateStride + group;
+            auto x1 = batch::load_aligned(state + kX1);
+            auto x2 = batch::load_aligned(state + kX2);
+            auto y1 = batch::load_aligned(state + kY1);
+            auto y2 = batch::load_aligned(state + kY2);
+            const batch ca(block.a[i]);
+            const batch cb(block.b[i]);
+
+            for (int n = 0; n < block.num_samples; ++n) {
+                float* frame = frames + n * kLanes;
+                auto x = batch::load_aligned(frame);
+                auto y = x2 + x1 * ca - y1 * ca - y2 * cb + x * cb;
+                y.store_aligned(frame);
+                x2 = x1;
+                x1 = x;
+                y2 = y1;
+                y1 = y;
+            }
+
+            x1.store_aligned(state + kX1);
+            x2.store_aligned(state + kX2);
+            y1.store_aligned(state + kY1);
+            y2.store_aligned(state + kY2);
+        }
+
+        // deinterleave
+        for (int n = 0; n < block.num_samples; ++n) {
+            const float* frame = frames + n * kLanes;
+            for (int c = 0; c < num_lanes; ++c) {
+                block.channels[group + c][n] = frame[c];
+            }
+        }
+    }
+}
@@ -0,0 +1,3 @@
+#include "channel_lane_kernel.hpp"
+
+template void ChannelLaneAllPass::ProcessBlock<xsimd::sse2>(const Block&);
\ No newline at end of file
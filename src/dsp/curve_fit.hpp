@@ -0,0 +1,195 @@
+#pragma once
+#include <vector>
+#include <string_view>
+#include <charconv>
+#include <utility>
+#include <functional>
+#include <cmath>
+#include <algorithm>
+#include "curve_v2.h"
+
+/*
+* measured or exported curves reduced to the few CurveV2 points that stay within a tolerance.
+* ramer-douglas-peucker on kExp segments: a span of samples is one segment when the best power for
+* it keeps every sample within the tolerance, otherwise it is split at the worst sample and both
+* halves are tried again
+*/
+class CurveFit {
+public:
+    struct Sample {
+        float x;
+        float y;
+    };
+
+    /**
+     * @brief two numbers per row, split by ',', ';', tab or space. empty rows, '#' comments and a
+     *        header row before the first sample are skipped
+     * @return false when a row is not two numbers or there are less than 2 samples
+     */
+    static bool ParseCsv(std::string_view text, std::vector<Sample>& out) {
+        out.clear();
+        while (!text.empty()) {
+            auto line_end = text.find_first_of("\r\n");
+            auto line = text.substr(0, line_end);
+            text.remove_prefix(line_end == std::string_view::npos ? text.size() : line_end + 1);
+
+            SkipSeparators(line);
+            if (line.empty() || line.front() == '#') {
+                continue;
+            }
+            Sample sample{};
+            if (!ParseNumber(line, sample.x) || !ParseNumber(line, sample.y)) {
+                if (out.empty()) { // header
+                    continue;
+                }
+                return false;
+            }
+            out.push_back(sample);
+        }
+        return out.size() >= 2;
+    }
+
+    /**
+     * @param samples x and y 0~1, any order. outside is clamped, not finite is dropped
+     * @param tolerance largest y error of any sample
+     * @return kExp points from x 0 to x 1, empty without samples
+     */
+    static std::vector<mana::CurveV2::Point> Fit(std::vector<Sample> samples, float tolerance) {
+        std::erase_if(samples, [](const Sample& s) {
+            return !std::isfinite(s.x) || !std::isfinite(s.y);
+        });
+        if (samples.empty()) {
+            return {};
+        }
+        for (auto& s : samples) {
+            s.x = std::clamp(s.x, 0.0f, 1.0f);
+            s.y = std::clamp(s.y, 0.0f, 1.0f);
+        }
+        std::ranges::stable_sort(samples, std::less{}, &Sample::x);
+        // the curve always runs from 0 to 1, the ends hold the nearest sample
+        if (samples.front().x > 0.0f) {
+            samples.insert(samples.begin(), Sample{ 0.0f, samples.front().y });
+        }
+        if (samples.back().x < 1.0f || samples.size() == 1) {
+            samples.push_back(Sample{ 1.0f, samples.back().y });
+        }
+
+        // power of the segment starting at a kept sample
+        std::vector<float> power(samples.size(), 0.0f);
+        std::vector<bool> keep(samples.size(), false);
+        keep.front() = true;
+        keep.back() = true;
+        std::vector<std::pair<size_t, size_t>> spans{ { 0, samples.size() - 1 } };
+        while (!spans.empty()) {
+            auto [begin, end] = spans.back();
+            spans.pop_back();
+
+            auto fit = FitSegment(samples, begin, end);
+            if (fit.worst == end || fit.error <= tolerance) {
+                power[begin] = fit.power;
+                continue;
+            }
+            keep[fit.worst] = true;
+            spans.emplace_back(begin, fit.worst);
+            spans.emplace_back(fit.worst, end);
+        }
+
+        std::vector<mana::CurveV2::Point> points;
+        for (size_t i = 0; i < samples.size(); ++i) {
+            if (keep[i]) {
+                points.emplace_back(samples[i].x, samples[i].y, power[i], mana::CurveV2::PowerEnum::kExp);
+            }
+        }
+        return points;
+    }
+private:
+    struct SegmentFit {
+        float power;
+        // largest error of the samples in between and the sample it is at, end when there is none
+        float error;
+        size_t worst;
+    };
+
+    static void SkipSeparators(std::string_view& text) {
+        auto first = text.find_first_not_of(" \t,;");
+        text.remove_prefix(first == std::string_view::npos ? text.size() : first);
+    }
+
+    static bool ParseNumber(std::string_view& text, float& value) {
+        if (!text.empty() && text.front() == '+') {
+            text.remove_prefix(1);
+        }
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (ec != std::errc{}) {
+            return false;
+        }
+        text.remove_prefix(static_cast<size_t>(end - text.data()));
+        SkipSeparators(text);
+        return true;
+    }
+
+    /**
+     * @brief signed error of sample i against the kExp segment from sample begin to sample end
+     */
+    static float SegmentError(const std::vector<Sample>& samples, size_t begin, size_t end, float power, size_t i) {
+        const auto& a = samples[begin];
+        const auto& b = samples[end];
+        auto range = b.x - a.x;
+        auto nor_x = range > 0.0f ? (samples[i].x - a.x) / range : 0.0f;
+        auto y = std::lerp(a.y, b.y, mana::CurveV2::GetPowerYValue(nor_x, mana::CurveV2::PowerEnum::kExp, power));
+        return samples[i].y - y;
+    }
+
+    static SegmentFit MaxError(const std::vector<Sample>& samples, size_t begin, size_t end, float power) {
+        SegmentFit fit{ power, 0.0f, end };
+        for (auto i = begin + 1; i < end; ++i) {
+            auto error = std::abs(SegmentError(samples, begin, end, power, i));
+            if (error > fit.error || fit.worst == end) {
+                fit.error = error;
+                fit.worst = i;
+            }
+        }
+        return fit;
+    }
+
+    /**
+     * @brief golden section search of the power with the smallest largest error, a line is tried too
+     */
+    static SegmentFit FitSegment(const std::vector<Sample>& samples, size_t begin, size_t end) {
+        constexpr int kNumIterations = 40;
+        constexpr float kInvPhi = 0.618034f;
+        if (end - begin < 2) {
+            return SegmentFit{ 0.0f, 0.0f, end };
+        }
+
+        auto error = [&](float power) {
+            return MaxError(samples, begin, end, power).error;
+        };
+        float lo = -1.0f;
+        float hi = 1.0f;
+        float c = hi - kInvPhi * (hi - lo);
+        float d = lo + kInvPhi * (hi - lo);
+        float error_c = error(c);
+        float error_d = error(d);
+        for (int i = 0; i < kNumIterations; ++i) {
+            if (error_c < error_d) {
+                hi = d;
+                d = c;
+                error_d = error_c;
+                c = hi - kInvPhi * (hi - lo);
+                error_c = error(c);
+            }
+            else {
+                lo = c;
+                c = d;
+                error_c = error_d;
+                d = lo + kInvPhi * (hi - lo);
+                error_d = error(d);
+            }
+        }
+
+        auto best = MaxError(samples, begin, end, 0.5f * (lo + hi));
+        auto line = MaxError(samples, begin, end, 0.0f);
+        return line.error <= best.error ? line : best;
+    }
+};
@@ -3,16 +3,23 @@
 #include <cassert>
 #include <cmath>
 #include <numbers>
+#include <stdexcept>
 #include <nlohmann/json.hpp>
+#include "binary_io.hpp"
 
 namespace mana {
+// shared by GetPowerYValue and the segments the kernels render
+static constexpr auto kMaxPow = 20;
+static constexpr auto kMaxWaveCycles = 64.0f;
+static constexpr auto kMaxSquareCycles = 63.0f;
+
 float CurveV2::GetPowerYValue(float nor_x, PowerEnum power_type, float power) {
     switch (power_type) {
     case PowerEnum::kKeep:
         return 0.0f;
     case PowerEnum::kExp:
     {
-        constexpr auto max_pow = 20;
+        constexpr auto max_pow = kMaxPow;
         auto mapped_exp_base = power * max_pow;
         if (std::abs(mapped_exp_base) <= 1e-3) // almost line
             return nor_x;
@@ -23,7 +30,7 @@ float CurveV2::GetPowerYValue(float nor_x, PowerEnum power_type, float power) {
     }
     case PowerEnum::kWaveSine:
     {
-        constexpr auto max_cycles = 64.0f;
+        constexpr auto max_cycles = kMaxWaveCycles;
         auto map_v = power * 0.5f + 0.5f;
         auto cycles = std::round(map_v * max_cycles) + 0.5f;
         auto cos_v = -std::cos(cycles * nor_x * std::numbers::pi_v<float> *2.0f);
@@ -31,7 +38,7 @@ float CurveV2::GetPowerYValue(float nor_x, PowerEnum power_type, float power) {
     }
     case PowerEnum::kWaveTri:
     {
-        constexpr auto max_cycles = 64.0f;
+        constexpr auto max_cycles = kMaxWaveCycles;
         auto map_v = power * 0.5f + 0.5f;
         auto cycles = std::round(map_v * max_cycles) + 0.5f;
         float tmp{};
@@ -40,7 +47,7 @@ float CurveV2::GetPowerYValue(float nor_x, PowerEnum power_type, float power) {
     }
     case PowerEnum::kWaveSquare:
     {
-        constexpr auto max_cycles = 63.0f;
+        constexpr auto max_cycles = kMaxSquareCycles;
         auto map_v = power * 0.5f + 0.5f;
         auto cycles = std::round(map_v * max_cycles) + 1.0f;
         float tmp{};
@@ -52,6 +59,41 @@ float CurveV2::GetPowerYValue(float nor_x, PowerEnum power_type, float power) {
         return 0.0f;
     }
 }
+
+CurveV2::Segment CurveV2::MakeSegment(const Point& curr, const Point& next, float* out, int num) {
+    Segment segment{ out, num, curr.y, next.y, Segment::Shape::kHold, 0.0f, 0.0f };
+    auto map_v = curr.power * 0.5f + 0.5f;
+    switch (curr.power_type) {
+    case PowerEnum::kKeep:
+        break;
+    case PowerEnum::kExp:
+        segment.param = curr.power * kMaxPow;
+        if (std::abs(segment.param) <= 1e-3) { // almost line
+            segment.shape = Segment::Shape::kLine;
+        }
+        else {
+            segment.shape = Segment::Shape::kExp;
+            segment.scale = 1.0f / (std::exp(segment.param) - 1.0f);
+        }
+        break;
+    case PowerEnum::kWaveSine:
+        segment.shape = Segment::Shape::kSine;
+        segment.param = std::round(map_v * kMaxWaveCycles) + 0.5f;
+        break;
+    case PowerEnum::kWaveTri:
+        segment.shape = Segment::Shape::kTri;
+        segment.param = std::round(map_v * kMaxWaveCycles) + 0.5f;
+        break;
+    case PowerEnum::kWaveSquare:
+        segment.shape = Segment::Shape::kSquare;
+        segment.param = std::round(map_v * kMaxSquareCycles) + 1.0f;
+        break;
+    default:
+        assert(false);
+        break;
+    }
+    return segment;
+}
 }
 
 namespace mana {
@@ -94,15 +136,18 @@ void CurveV2::Remove(int idx) {
 }
 
 void CurveV2::AddPoint(Point point) {
-    const size_t num_loop = points_.size() - 1;
-    for (size_t i = 0; i < num_loop; ++i) {
-        if (point.x >= points_[i].x
-            && point.x <= points_[i + 1].x) {
-            AddBehind(i, point);
-            return;
-        }
-    }
-    AddBehind(points_.size() - 1, point);
+    // behind the last point left of it, the first point never moves
+    auto next = std::lower_bound(points_.cbegin() + 1, points_.cend(), point.x, [](const Point& p, float x) {
+        return p.x < x;
+    });
+    AddBehind(static_cast<int>(next - points_.cbegin()) - 1, point);
+}
+
+int CurveV2::LowerBound(float nor_x) const {
+    auto it = std::lower_bound(points_.cbegin(), points_.cend(), nor_x, [](const Point& p, float x) {
+        return p.x < x;
+    });
+    return static_cast<int>(it - points_.cbegin());
 }
 
 void CurveV2::AddBehind(int idx, Point point) {
@@ -112,11 +157,15 @@ void CurveV2::AddBehind(int idx, Point point) {
 }
 
 void CurveV2::PartRender(int begin_point_idx, int end_point_idx) {
+    static const auto render_segment = xsimd::dispatch<SimdArchList>([]<class Arch>(Arch) -> RenderSegmentFn {
+        return &CurveV2::RenderSegment<Arch>;
+    })();
+
     begin_point_idx = std::max(0, begin_point_idx);
     end_point_idx = std::min(end_point_idx, static_cast<int>(points_.size()));
     // i think add function will keep order
     // so we can use these to render
-    // todo: thread safty
+    // only the editing thread touches these, other threads read the snapshot published below
     for (int i = begin_point_idx; i < end_point_idx; ++i) {
         if (i + 1 >= static_cast<int>(points_.size()))
             break;
@@ -129,19 +178,98 @@ void CurveV2::PartRender(int begin_point_idx, int end_point_idx) {
         if (begin_idx == end_idx) // do not render because it will divide by 0
             continue;
 
-        auto curr_y = curr_point.y;
-        auto next_y = next_point.y;
-        auto x_range = end_idx - begin_idx;
-        auto fx_range = static_cast<float>(x_range);
-        auto inv_range = 1.0f / x_range;
-        for (int x = 0; x < x_range; ++x) {
-            auto nor_x = x * inv_range;
-            auto map_x = CurveV2::GetPowerYValue(nor_x, curr_point.power_type, curr_point.power);
-            datas_[x + begin_idx] = std::lerp(curr_y, next_y, map_x);
-        }
+        render_segment(MakeSegment(curr_point, next_point, datas_.data() + begin_idx, end_idx - begin_idx));
     }
     datas_[num_data_] = datas_[num_data_ - 1];
     datas_[num_data_ + 1] = datas_[num_data_];
+    Publish();
+}
+
+void CurveV2::CommitEdit() {
+    assert(IsEditing());
+    if (!edit_changed_)
+        return;
+
+    edit_changed_ = false;
+    PublishSnapshot();
+    listeners_.CallListener(&Listener::OnEditCommit, this);
+}
+
+void CurveV2::EndEdit() {
+    assert(IsEditing());
+    if (edit_depth_.fetch_sub(1, std::memory_order_acq_rel) > 1)
+        return;
+
+    if (edit_changed_) {
+        edit_changed_ = false;
+        PublishSnapshot();
+    }
+    listeners_.CallListener(&Listener::OnEditEnd, this);
+}
+
+void CurveV2::Publish() {
+    if (IsEditing()) {
+        edit_changed_ = true;
+        return;
+    }
+    PublishSnapshot();
+}
+
+void CurveV2::PublishSnapshot() {
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->points_ = points_;
+    std::atomic_store_explicit(&snapshot_, std::shared_ptr<const Snapshot>{ std::move(snapshot) }, std::memory_order_release);
+}
+
+float CurveV2::Snapshot::GetNormalize(float nor) const {
+    // first point right of nor, the segment before it holds nor
+    auto next = std::upper_bound(points_.cbegin(), points_.cend(), nor, [](float x, const Point& p) {
+        return x < p.x;
+    });
+    if (next == points_.cbegin())
+        return points_.front().y;
+    if (next == points_.cend())
+        return points_.back().y;
+
+    const auto& curr = *(next - 1);
+    auto nor_x = (nor - curr.x) / (next->x - curr.x);
+    return std::lerp(curr.y, next->y, GetPowerYValue(nor_x, curr.power_type, curr.power));
+}
+
+float CurveV2::Snapshot::GetMinimum(float nor_begin, float nor_end) const {
+    if (nor_begin > nor_end)
+        std::swap(nor_begin, nor_end);
+
+    // every shape starts at its point, exp is monotonic, so the ends and the points in between cover
+    // all but the waves
+    auto minimum = std::min(GetNormalize(nor_begin), GetNormalize(nor_end));
+    for (size_t i = 0; i + 1 < points_.size(); ++i) {
+        const auto& curr = points_[i];
+        const auto& next = points_[i + 1];
+        if (next.x <= nor_begin || curr.x > nor_end)
+            continue;
+        if (curr.x >= nor_begin)
+            minimum = std::min(minimum, curr.y);
+
+        auto segment = MakeSegment(curr, next, nullptr, 0);
+        if (segment.shape != Segment::Shape::kSine
+            && segment.shape != Segment::Shape::kTri
+            && segment.shape != Segment::Shape::kSquare)
+            continue;
+
+        // waves reach y at even and next y at odd half cycles, the square switches there
+        auto range = next.x - curr.x;
+        auto half_cycles = 2.0f * segment.param;
+        auto first = std::ceil(std::max(0.0f, (nor_begin - curr.x) / range) * half_cycles);
+        // the last half cycle ends on the next point, that is the next segment
+        auto last = std::floor(std::min(1.0f, (nor_end - curr.x) / range) * half_cycles);
+        last = std::min(last, half_cycles - 1.0f);
+        if (first < last)
+            minimum = std::min({ minimum, curr.y, next.y });
+        else if (first == last)
+            minimum = std::min(minimum, std::fmod(first, 2.0f) == 0.0f ? curr.y : next.y);
+    }
+    return minimum;
 }
 
 void CurveV2::SetXy(int idx, float new_x, float new_y) {
@@ -234,7 +362,75 @@ void CurveV2::LoadState(const nlohmann::json& json) {
         auto type = kNameToEnumMap.at(p["type"].get<std::string>());
         new_points.push_back(Point{ x, y, power, type });
     }
-    std::ranges::sort(new_points, std::less{}, &Point::x);
+    if (!IsValidCurve(new_points)) {
+        throw std::runtime_error{ "invalid curve" };
+    }
+    ReloadPoints(std::move(new_points));
+}
+
+void CurveV2::SaveState(BinaryWriter& writer) const {
+    writer.Write(static_cast<uint32_t>(points_.size()));
+    for (const auto& p : points_) {
+        writer.Write(p.x);
+        writer.Write(p.y);
+        writer.Write(p.power);
+        writer.Write(static_cast<uint8_t>(p.power_type));
+    }
+}
+
+bool CurveV2::LoadState(BinaryReader& reader) {
+    decltype(points_) new_points;
+    if (!ReadPoints(reader, new_points)) {
+        return false;
+    }
+    ReloadPoints(std::move(new_points));
+    return true;
+}
+
+bool CurveV2::ReadPoints(BinaryReader& reader, std::vector<Point>& new_points) {
+    constexpr size_t kPointSize = 3 * sizeof(float) + sizeof(uint8_t);
+    uint32_t num_points{};
+    if (!reader.Read(num_points) || reader.GetRemaining() / kPointSize < num_points) {
+        return false;
+    }
+
+    new_points.clear();
+    new_points.reserve(num_points);
+    for (uint32_t i = 0; i < num_points; ++i) {
+        float x{};
+        float y{};
+        float power{};
+        uint8_t type{};
+        reader.Read(x);
+        reader.Read(y);
+        reader.Read(power);
+        reader.Read(type);
+        if (type >= static_cast<uint8_t>(PowerEnum::kNumPowerEnums)) {
+            return false;
+        }
+        new_points.push_back(Point{ x, y, power, static_cast<PowerEnum>(type) });
+    }
+    return IsValidCurve(new_points);
+}
+
+bool CurveV2::IsValidCurve(const std::vector<Point>& points) {
+    if (points.size() < 2 || points.front().x != 0.0f || points.back().x != 1.0f)
+        return false;
+
+    // the negated compares are false for nan too
+    float last_x = 0.0f;
+    for (const auto& p : points) {
+        if (!(p.x >= last_x && p.x <= 1.0f)
+            || !(p.y >= 0.0f && p.y <= 1.0f)
+            || !(p.power >= -1.0f && p.power <= 1.0f))
+            return false;
+        last_x = p.x;
+    }
+    return true;
+}
+
+void CurveV2::ReloadPoints(std::vector<Point> new_points) {
+    assert(IsValidCurve(new_points));
     points_ = std::move(new_points);
     FullRender();
     listeners_.CallListener(&Listener::OnReload, this);
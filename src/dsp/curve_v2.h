@@ -2,10 +2,15 @@
 
 #include <vector>
 #include <memory>
+#include <atomic>
 #include <algorithm>
 #include <cmath>
 #include <nlohmann/json_fwd.hpp>
 #include "listener_list.h"
+#include "simd_arch.hpp"
+
+class BinaryWriter;
+class BinaryReader;
 
 namespace mana {
 class CurveV2 {
@@ -28,6 +33,38 @@ public:
     };
     static float GetPowerYValue(float nor_x, PowerEnum power_type, float power);
 
+    /*
+    * the table entries between two points, with the power type and its constants resolved once
+    * so the kernel renders a whole batch of entries per step
+    */
+    struct Segment {
+        enum class Shape {
+            kHold,
+            kLine,
+            kExp,
+            kSine,
+            kTri,
+            kSquare
+        };
+        float* out;
+        int num;
+        float y0;
+        float y1;
+        Shape shape;
+        // exp: exponent at x = 1, waves: cycles
+        float param;
+        // exp: 1 / (e^param - 1)
+        float scale;
+    };
+    using RenderSegmentFn = void(*)(const Segment& segment);
+
+    /**
+     * @brief out[i] = lerp(y0, y1, GetPowerYValue(i / num)), compiled once per ISA in curve_v2_<isa>.cpp
+     *        see curve_v2_kernel.hpp
+     */
+    template<class Arch>
+    static void RenderSegment(const Segment& segment);
+
     struct Point {
         constexpr Point(float x, float y, float power = 0.0f, PowerEnum power_type = PowerEnum::kExp)
             : x(x), y(y), power(power), power_type(power_type) {}
@@ -38,6 +75,29 @@ public:
         PowerEnum power_type{ PowerEnum::kExp };
     };
 
+    /*
+    * points of one state of the curve, never changes once published.
+    * other threads take the newest with GetSnapshot and read it without locking for as long as they hold it.
+    * it keeps no table, segments are evaluated from the points when asked, so the designer gets the
+    * exact curve at any resolution and a snapshot costs only its points
+    */
+    class Snapshot {
+    public:
+        /**
+         * @brief value of the curve at nor, no interpolation error. O(log points)
+         * @param nor 0~1
+         */
+        float GetNormalize(float nor) const;
+        // lowest value GetNormalize can return between nor_begin and nor_end
+        float GetMinimum(float nor_begin, float nor_end) const;
+
+        const std::vector<Point>& GetAllPoints() const { return points_; }
+        int GetNumPoints() const { return static_cast<int>(points_.size()); }
+    private:
+        friend class CurveV2;
+        std::vector<Point> points_;
+    };
+
     class Listener {
     public:
         virtual ~Listener() = default;
@@ -46,16 +106,47 @@ public:
         virtual void OnPointXyChanged(CurveV2* generator, int changed_idx) = 0;
         virtual void OnPointPowerChanged(CurveV2* generator, int changed_idx) = 0;
         virtual void OnReload(CurveV2* generator) = 0;
+        // an open edit published what it changed so far, see CommitEdit
+        virtual void OnEditCommit(CurveV2* generator) {}
+        // the outermost EndEdit ran, whether the curve changed or not
+        virtual void OnEditEnd(CurveV2* generator) {}
+    };
+
+    /*
+    * BeginEdit/EndEdit around an edit of many points, or of the curve together with other settings,
+    * other threads see it as one edit. the point listeners are still called for every change,
+    * GetSnapshot keeps returning the curve from before the edit until CommitEdit or the outermost
+    * EndEdit publishes it
+    */
+    class ScopedEdit {
+    public:
+        explicit ScopedEdit(CurveV2& curve) : curve_(curve) { curve_.BeginEdit(); }
+        ~ScopedEdit() { curve_.EndEdit(); }
+        ScopedEdit(const ScopedEdit&) = delete;
+        ScopedEdit& operator=(const ScopedEdit&) = delete;
+    private:
+        CurveV2& curve_;
     };
 
     CurveV2(int size = kLineResolution, CurveInitEnum init = CurveInitEnum::kNull);
     CurveV2(const CurveV2&) = delete;
     CurveV2& operator=(const CurveV2&) = delete;
-    CurveV2(CurveV2&&) = default;
-    CurveV2& operator=(CurveV2&&) = default;
 
     void Init(CurveInitEnum init);
 
+    // can nest
+    void BeginEdit() { edit_depth_.fetch_add(1, std::memory_order_acq_rel); }
+    /**
+     * @brief publishes what the open edit changed so far, for an edit that is heard while it goes on like a drag
+     */
+    void CommitEdit();
+    // the outermost one publishes and calls OnEditEnd
+    void EndEdit();
+    /**
+     * @brief any thread
+     */
+    bool IsEditing() const { return edit_depth_.load(std::memory_order_acquire) > 0; }
+
     void Remove(int idx);
     void AddBehind(int idx, Point point);
     void AddPoint(Point point);
@@ -70,10 +161,19 @@ public:
     }
     float GetNormalize(float nor) { return Get(num_data_ * nor); }
 
+    /**
+     * @brief the curve as of the last edit, safe to call from any thread while the edits go on
+     */
+    std::shared_ptr<const Snapshot> GetSnapshot() const { return std::atomic_load_explicit(&snapshot_, std::memory_order_acquire); }
+
     decltype(auto) GetAllPoints() { return (points_); }
     decltype(auto) GetAllPoints() const { return (points_); }
     int GetNumPoints() const { return static_cast<int>(points_.size()); }
     Point GetPoint(int idx) { return points_[idx]; }
+    /**
+     * @brief index of the first point with x >= nor_x, GetNumPoints() when there is none. O(log points)
+     */
+    int LowerBound(float nor_x) const;
 
     void SetXy(int idx, float new_x, float new_y);
     void SetPower(int idx, float new_power);
@@ -86,11 +186,49 @@ public:
     void RemoveListener(Listener* l) { listeners_.RemoveListener(l); }
 
     nlohmann::json SaveState() const;
+    /**
+     * @brief throws when the points are not a valid curve, the curve is unchanged then
+     */
     void LoadState(const nlohmann::json& j);
+    /**
+     * @brief u32 number of points, then x, y, power as f32 and the power type id as u8 of every point
+     */
+    void SaveState(BinaryWriter& writer) const;
+    /**
+     * @return false and the curve unchanged when the data is damaged
+     */
+    bool LoadState(BinaryReader& reader);
+    /**
+     * @brief reads what SaveState wrote without touching any curve, so a state can be checked whole first
+     * @return false when the data is damaged or is not a valid curve
+     */
+    static bool ReadPoints(BinaryReader& reader, std::vector<Point>& out);
+    /**
+     * @brief at least 2 points, all finite, x 0~1 and not decreasing from 0 to 1, y 0~1, power -1~1
+     */
+    static bool IsValidCurve(const std::vector<Point>& points);
+    /**
+     * @brief replaces every point, they must be a valid curve
+     */
+    void ReloadPoints(std::vector<Point> new_points);
 private:
+    static Segment MakeSegment(const Point& curr, const Point& next, float* out, int num);
+    // after every edit, on the thread that edits. held back while an edit is open
+    void Publish();
+    void PublishSnapshot();
+
     int num_data_;
     std::vector<Point> points_;
     std::vector<float> datas_;
+    // only through std::atomic_load/std::atomic_store, libc++ has no std::atomic<std::shared_ptr>
+    std::shared_ptr<const Snapshot> snapshot_;
+    // atomic so the audio thread can ask IsEditing
+    std::atomic<int> edit_depth_{};
+    bool edit_changed_{};
     utli::ListenerList<Listener> listeners_;
 };
+
+extern template void CurveV2::RenderSegment<xsimd::sse2>(const Segment&);
+extern template void CurveV2::RenderSegment<xsimd::avx2>(const Segment&);
+extern template void CurveV2::RenderSegment<xsimd::avx512f>(const Segment&);
 }
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+#include <numbers>
+#include "curve_v2.h"
+
+/*
+* only include this in the curve_v2_<isa>.cpp files, same rules as stack_allpass_kernel.hpp
+*/
+
+namespace mana {
+template<class Arch>
+void CurveV2::RenderSegment(const Segment& segment) {
+    using batch = xsimd::batch<float, Arch>;
+    constexpr int kLanes = static_cast<int>(batch::size);
+
+    alignas(64) float lane_index[kLanes];
+    for (int i = 0; i < kLanes; ++i) {
+        lane_index[i] = static_cast<float>(i);
+    }
+    const auto iota = batch::load_aligned(lane_index);
+    const auto inv_range = 1.0f / segment.num;
+    const batch y0(segment.y0);
+    const batch dy(segment.y1 - segment.y0);
+
+    // the shape is picked once, the loop below is inlined for each one
+    auto render = [&](auto map) {
+        for (int i = 0; i < segment.num; i += kLanes) {
+            auto nor_x = (batch(static_cast<float>(i)) + iota) * inv_range;
+            auto y = xsimd::fma(map(nor_x), dy, y0);
+            if (i + kLanes <= segment.num) {
+                y.store_unaligned(segment.out + i);
+            }
+            else {
+                alignas(64) float tail[kLanes];
+                y.store_aligned(tail);
+                // a plain loop, std::copy would be an inline function shared with the other isa
+                for (int j = 0; j < segment.num - i; ++j) {
+                    segment.out[i + j] = tail[j];
+                }
+            }
+        }
+    };
+    // 0~1 phase of the waves
+    auto phase = [&](batch nor_x) {
+        auto t = nor_x * segment.param;
+        return t - xsimd::floor(t);
+    };
+
+    switch (segment.shape) {
+    case Segment::Shape::kHold:
+        render([](batch) { return batch(0.0f); });
+        break;
+    case Segment::Shape::kLine:
+        render([](batch nor_x) { return nor_x; });
+        break;
+    case Segment::Shape::kExp:
+        render([&](batch nor_x) {
+            return (xsimd::exp(nor_x * segment.param) - 1.0f) * segment.scale;
+        });
+        break;
+    case Segment::Shape::kSine:
+        render([&](batch nor_x) {
+            return 0.5f - 0.5f * xsimd::cos(nor_x * (segment.param * 2.0f * std::numbers::pi_v<float>));
+        });
+        break;
+    case Segment::Shape::kTri:
+        render([&](batch nor_x) {
+            return 1.0f - xsimd::abs(1.0f - 2.0f * phase(nor_x));
+        });
+        break;
+    case Segment::Shape::kSquare:
+        render([&](batch nor_x) {
+            return xsimd::select(phase(nor_x) < 0.5f, batch(0.0f), batch(1.0f));
+        });
+        break;
+    }
+}
+}
@@ -0,0 +1,3 @@
+#include "curve_v2_kernel.hpp"
+
+template void mana::CurveV2::RenderSegment<xsimd::sse2>(const mana::CurveV2::Segment&);
\ No newline at end of file
@@ -0,0 +1,515 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <numbers>
+#include <algorithm>
+#include "stack_allpass.hpp"
+#include "group_delay.hpp"
+#include "convert.hpp"
+#include "curve_v2.h"
+
+/*
+* turns a delay curve into allpass sections in ascending frequency order, plus the bulk
+* delay taken out of the curve.
+* the phase of every resolution step is summed once into a prefix sum, a section ends where
+* it crosses the next multiple of 2pi, which is a binary search per section.
+* every section remembers the resolution step it ends on and the phase integral carried
+* past it, so when only part of the curve changes just the sections over that part are
+* integrated again and the rest keep their coefficients
+*/
+class DelayDesign {
+public:
+    static constexpr float kMaxBulkDelayMs = 1000.0f;
+    static constexpr float kAutoBulkDelay = -1.0f;
+    // sections rebuilt on each side of a change. the phase of a rebuilt run is rounded to
+    // whole sections, with fewer the rounding would bend the group delay noticeably
+    static constexpr size_t kRedesignMargin = 16;
+
+    DelayDesign() {
+        magic_beta_ = std::sqrt(beta_ / (1 - beta_));
+    }
+
+    void SetSampleRate(float sample_rate) {
+        if (sample_rate != sample_rate_) {
+            sample_rate_ = sample_rate;
+            valid_ = false;
+        }
+    }
+
+    float GetSampleRate() const {
+        return sample_rate_;
+    }
+
+    /**
+     * @brief upper bound of the sections of any design with these limits
+     * @param max_delay_ms of the curve, before the bulk delay is taken out
+     */
+    static size_t GetMaxNumSections(int max_resulotion, float max_delay_ms, float sample_rate) {
+        // every section spans at least one step and takes 2pi of phase, the phase over
+        // 0~pi is at most pi times the largest delay
+        auto by_phase = static_cast<size_t>(max_delay_ms * sample_rate / 1000.0f / 2.0f) + 1;
+        return std::min(static_cast<size_t>(max_resulotion), by_phase);
+    }
+
+    /**
+     * @brief designs of up to max_resulotion steps and max_sections do not allocate after this
+     */
+    void Reserve(int max_resulotion, size_t max_sections) {
+        const auto num_steps = static_cast<size_t>(max_resulotion);
+        for (auto* v : { &center_, &radius_, &bw_, &carry_, &run_center_, &run_radius_, &run_bw_, &run_carry_ }) {
+            v->reserve(max_sections);
+        }
+        end_step_.reserve(max_sections);
+        run_end_step_.reserve(max_sections);
+        steps_.reserve(num_steps);
+        new_steps_.reserve(num_steps);
+        phase_.reserve(num_steps + 1);
+        step_nor_.reserve(num_steps);
+    }
+
+    /**
+     * @param bw unit: hz
+     */
+    void SetMinBw(float bw) {
+        if (bw != min_bw_hz_) {
+            min_bw_hz_ = bw;
+            valid_ = false;
+        }
+    }
+
+    /**
+     * @brief only the pole radius depends on it, the sections stay where they are
+     */
+    void SetBeta(float beta) {
+        if (beta == beta_) {
+            return;
+        }
+
+        beta_ = beta;
+        magic_beta_ = std::sqrt(beta_ / (1 - beta_));
+        for (size_t i = 0; i < radius_.size(); ++i) {
+            radius_[i] = GetPoleRadius(bw_[i]);
+        }
+        RebuildAnalysis();
+    }
+
+    /**
+     * @param delay_ms kAutoBulkDelay uses the curve minimum, 0 disables, otherwise clamped to the curve minimum
+     */
+    void SetBulkDelay(float delay_ms) {
+        if (delay_ms != bulk_delay_ms_) {
+            bulk_delay_ms_ = delay_ms;
+            valid_ = false;
+        }
+    }
+
+    /**
+     * @brief
+     * @param curve unit: ms
+     * @param p_begin 0~1
+     * @param p_end 0~1
+     * @return true if any section changed
+     */
+    bool SetCurvePitchAxis(const mana::CurveV2::Snapshot& curve, int resulotion, float max_delay_ms, float p_begin, float p_end) {
+        constexpr auto twopi = std::numbers::pi_v<float> * 2;
+        const auto freq_begin_hz = SemitoneMap(p_begin);
+        const auto freq_end_hz = SemitoneMap(p_end);
+        const auto freq_interval_hz = (freq_end_hz - freq_begin_hz) / resulotion;
+        const auto nor_freq_interval = freq_interval_hz / sample_rate_ * twopi;
+        const auto bulk_ms = GetBulkDelayMs(curve, max_delay_ms, std::clamp(p_begin, 0.0f, 1.0f), std::clamp(p_end, 0.0f, 1.0f));
+
+        // the steps are linear in hz and the curve in semitone, the log2 only depends on the range
+        const StepGrid grid{ true, resulotion, p_begin, p_end };
+        if (!(grid == step_grid_)) {
+            step_grid_ = grid;
+            step_nor_.resize(resulotion);
+            for (int i = 0; i < resulotion; ++i) {
+                auto st = Hz2Semitone(freq_begin_hz + i * freq_interval_hz);
+                auto nor = (st - s_st_begin) / (s_st_end - s_st_begin);
+                step_nor_[i] = std::clamp(nor, 0.0f, 1.0f);
+            }
+        }
+        ComputeSteps(curve, max_delay_ms, bulk_ms, nor_freq_interval);
+
+        Layout layout{ true, resulotion, max_delay_ms, freq_begin_hz / sample_rate_ * twopi, freq_end_hz / sample_rate_ * twopi };
+        return Integrate(layout, bulk_ms);
+    }
+
+    /**
+     * @brief
+     * @param curve
+     * @param resulotion
+     * @param max_delay_ms
+     * @param f_begin 0~pi
+     * @param f_end 0~pi
+     * @return true if any section changed
+     */
+    bool SetCurve(const mana::CurveV2::Snapshot& curve, int resulotion, float max_delay_ms, float f_begin, float f_end) {
+        const auto freq_interval = (f_end - f_begin) / resulotion;
+        const auto bulk_ms = GetBulkDelayMs(curve, max_delay_ms, 0.0f, 1.0f);
+
+        const StepGrid grid{ false, resulotion, 0.0f, 1.0f };
+        if (!(grid == step_grid_)) {
+            step_grid_ = grid;
+            step_nor_.resize(resulotion);
+            for (int i = 0; i < resulotion; ++i) {
+                step_nor_[i] = i / (resulotion - 1.0f);
+            }
+        }
+        ComputeSteps(curve, max_delay_ms, bulk_ms, freq_interval);
+
+        Layout layout{ false, resulotion, max_delay_ms, f_begin, f_end };
+        return Integrate(layout, bulk_ms);
+    }
+
+    size_t GetNumSections() const {
+        return center_.size();
+    }
+
+    /**
+     * @brief the sections were designed from scratch. a design that only redid the sections around
+     *        a curve edit also depends on the curves before it, so it can differ a little from this
+     */
+    bool IsFullDesign() const {
+        return full_design_;
+    }
+
+    float GetCenter(size_t i) const {
+        return center_[i];
+    }
+
+    float GetRadius(size_t i) const {
+        return radius_[i];
+    }
+
+    float GetBw(size_t i) const {
+        return bw_[i];
+    }
+
+    /**
+     * @return samples
+     */
+    float GetBulkDelay() const {
+        return bulk_ms_ * sample_rate_ / 1000.0f;
+    }
+
+    float GetSectionGroupDelay(size_t i, float w) const {
+        return AllPassSectionGroupDelay(w, center_[i], radius_[i]);
+    }
+
+    /**
+     * @brief frequencies the summed group delay of the sections is kept up to date on
+     * @param w 0~pi
+     */
+    void SetAnalysisGrid(const std::vector<float>& w) {
+        grid_ = w;
+        analysis_grid_.SetGrid(w);
+        RebuildAnalysis();
+    }
+
+    float GetAnalysisFrequency(size_t i) const {
+        return grid_[i];
+    }
+
+    /**
+     * @return samples, without the bulk delay
+     */
+    float GetAnalysisGroupDelay(size_t i) const {
+        return static_cast<float>(analysis_[i]);
+    }
+private:
+    struct Layout {
+        bool pitch_axis{};
+        int resolution{};
+        float max_delay_ms{};
+        float f_begin{};
+        float f_end{};
+
+        bool operator==(const Layout&) const = default;
+    };
+
+    struct StepGrid {
+        bool pitch_axis{};
+        int resolution{};
+        float p_begin{};
+        float p_end{};
+
+        bool operator==(const StepGrid&) const = default;
+    };
+
+    /**
+     * @brief phase of every step into new_steps_, never negative so the prefix sum is sorted
+     */
+    void ComputeSteps(const mana::CurveV2::Snapshot& curve, float max_delay_ms, float bulk_ms, float freq_interval) {
+        const auto scale = freq_interval * sample_rate_ / 1000.0f;
+        new_steps_.resize(step_nor_.size());
+        for (size_t i = 0; i < step_nor_.size(); ++i) {
+            auto delay_ms = curve.GetNormalize(step_nor_[i]) * max_delay_ms - bulk_ms;
+            new_steps_[i] = std::max(0.0f, delay_ms * scale);
+        }
+    }
+
+    /**
+     * @brief phase_[i] is the phase of the first i steps
+     */
+    void UpdatePrefix(size_t first_step) {
+        phase_.resize(steps_.size() + 1);
+        phase_[0] = 0.0;
+        for (auto i = first_step; i < steps_.size(); ++i) {
+            phase_[i + 1] = phase_[i] + steps_[i];
+        }
+    }
+
+    /**
+     * @brief first step count after begin_step whose phase reaches target, steps_.size() + 1 if none does
+     */
+    size_t FindCrossing(size_t begin_step, double target) const {
+        return std::lower_bound(phase_.begin() + begin_step + 1, phase_.end(), target) - phase_.begin();
+    }
+
+    /**
+     * @brief full design if anything but the curve changed, otherwise only around the changed steps
+     */
+    bool Integrate(const Layout& layout, float bulk_ms) {
+        constexpr auto twopi = std::numbers::pi_v<float> * 2;
+        const bool full = !valid_ || !(layout == layout_) || bulk_ms != bulk_ms_ || steps_.size() != new_steps_.size();
+        layout_ = layout;
+        bulk_ms_ = bulk_ms;
+        valid_ = true;
+        freq_interval_ = (layout.f_end - layout.f_begin) / layout.resolution;
+        min_bw_ = min_bw_hz_ / sample_rate_ * twopi;
+
+        if (full) {
+            full_design_ = true;
+            steps_.swap(new_steps_);
+            UpdatePrefix(0);
+            DesignFrom(0);
+            RebuildAnalysis();
+            return true;
+        }
+
+        size_t first = 0;
+        while (first < steps_.size() && steps_[first] == new_steps_[first]) {
+            ++first;
+        }
+        if (first == steps_.size()) {
+            return false;
+        }
+        size_t last = steps_.size() - 1;
+        while (steps_[last] == new_steps_[last]) {
+            --last;
+        }
+        full_design_ = false;
+        steps_.swap(new_steps_);
+        UpdatePrefix(first);
+
+        // section k integrates the steps end_step_[k - 1]..end_step_[k]
+        auto num_sections = center_.size();
+        size_t begin = std::ranges::upper_bound(end_step_, first) - end_step_.begin();
+        size_t end = std::ranges::upper_bound(end_step_, last) - end_step_.begin();
+        begin = begin > kRedesignMargin ? begin - kRedesignMargin : 0;
+        end += kRedesignMargin;
+
+        if (end >= num_sections) {
+            // the change reaches the last section, nothing after it has to stay in place
+            AccumulateAnalysis(begin, num_sections, -1.0);
+            DesignFrom(begin);
+            AccumulateAnalysis(begin, center_.size(), 1.0);
+        }
+        else {
+            AccumulateAnalysis(begin, end + 1, -1.0);
+            auto num_new = RedesignRun(begin, end);
+            AccumulateAnalysis(begin, begin + num_new, 1.0);
+        }
+        return true;
+    }
+
+    /**
+     * @brief drops the sections from first_section on and integrates them again up to the last step
+     */
+    void DesignFrom(size_t first_section) {
+        constexpr auto twopi = std::numbers::pi_v<double> * 2;
+        ResizeSections(first_section);
+
+        const auto resulotion = steps_.size();
+        size_t search_begin = first_section > 0 ? end_step_.back() : 0;
+        const double origin = phase_[search_begin] - (first_section > 0 ? carry_.back() : 0.0f);
+        auto section_begin = search_begin;
+        double next = twopi;
+        while (search_begin < resulotion) {
+            // sections end where the phase since origin crosses a multiple of 2pi, several
+            // multiples inside one step make one section like the step by step integration did
+            auto end_step = std::min(FindCrossing(search_begin, origin + next), resulotion);
+            auto intergal = phase_[end_step] - origin;
+            auto num_turns = std::floor(intergal / twopi);
+            next = (num_turns + 1) * twopi;
+            search_begin = end_step;
+
+            auto freq_end = end_step >= resulotion ? layout_.f_end : GetStepFreq(end_step);
+            auto freq_begin = GetStepFreq(section_begin);
+
+            // 创建一个全通滤波器
+            auto bw = freq_end - freq_begin;
+            if (bw > min_bw_) {
+                center_.push_back(freq_begin + bw / 2.0f);
+                radius_.push_back(GetPoleRadius(bw));
+                bw_.push_back(bw);
+                end_step_.push_back(end_step);
+                carry_.push_back(static_cast<float>(intergal - num_turns * twopi));
+                section_begin = end_step;
+            }
+        }
+    }
+
+    /**
+     * @brief replaces sections first..last with a run over the same steps that hands the same
+     *        carry to last + 1, so every section after it stays as it is
+     * @return sections in the new run
+     */
+    size_t RedesignRun(size_t first, size_t last) {
+        constexpr auto twopi = std::numbers::pi_v<double> * 2;
+        const auto begin_step = first > 0 ? end_step_[first - 1] : 0;
+        const auto carry_in = first > 0 ? carry_[first - 1] : 0.0f;
+        const auto end_step = end_step_[last];
+        const auto carry_out = carry_[last];
+
+        // the run takes whole sections, its phase is spread evenly over them
+        const double origin = phase_[begin_step] - carry_in;
+        const double phase = phase_[end_step] - origin - carry_out;
+        const auto num_target = std::max(1.0, std::round(phase / twopi));
+        const auto section_phase = phase / num_target;
+
+        run_center_.clear();
+        run_radius_.clear();
+        run_bw_.clear();
+        run_end_step_.clear();
+        run_carry_.clear();
+        auto push = [this](float freq_begin, float bw, size_t end, float carry) {
+            run_center_.push_back(freq_begin + bw / 2.0f);
+            run_radius_.push_back(GetPoleRadius(bw));
+            run_bw_.push_back(bw);
+            run_end_step_.push_back(end);
+            run_carry_.push_back(carry);
+        };
+
+        auto search_begin = begin_step;
+        auto section_begin = begin_step;
+        double next = section_phase;
+        while (next < num_target * section_phase - 0.5 * section_phase) {
+            auto step = FindCrossing(search_begin, origin + next);
+            if (step >= end_step) {
+                break;
+            }
+            auto intergal = phase_[step] - origin;
+            auto num_turns = std::floor(intergal / section_phase);
+            next = (num_turns + 1) * section_phase;
+            search_begin = step;
+
+            auto bw = GetStepFreq(step) - GetStepFreq(section_begin);
+            if (bw > min_bw_) {
+                push(GetStepFreq(section_begin), bw, step, static_cast<float>(intergal - num_turns * section_phase));
+                section_begin = step;
+            }
+        }
+        // the last one ends where the untouched sections begin
+        push(GetStepFreq(section_begin), GetStepFreq(end_step) - GetStepFreq(section_begin), end_step, carry_out);
+
+        auto splice = [first, last](auto& dst, const auto& src) {
+            dst.erase(dst.begin() + first, dst.begin() + last + 1);
+            dst.insert(dst.begin() + first, src.begin(), src.end());
+        };
+        splice(center_, run_center_);
+        splice(radius_, run_radius_);
+        splice(bw_, run_bw_);
+        splice(end_step_, run_end_step_);
+        splice(carry_, run_carry_);
+        return run_center_.size();
+    }
+
+    void ResizeSections(size_t num) {
+        center_.resize(num);
+        radius_.resize(num);
+        bw_.resize(num);
+        end_step_.resize(num);
+        carry_.resize(num);
+    }
+
+    float GetStepFreq(size_t step) const {
+        return layout_.f_begin + step * freq_interval_;
+    }
+
+    void RebuildAnalysis() {
+        analysis_.assign(grid_.size(), 0.0);
+        AccumulateAnalysis(0, center_.size(), 1.0);
+    }
+
+    void AccumulateAnalysis(size_t begin, size_t end, double sign) {
+        if (begin < end) {
+            analysis_grid_.Accumulate(center_.data() + begin, radius_.data() + begin, end - begin, analysis_.data(), sign);
+        }
+    }
+
+    /**
+     * @brief the part of the curve between nor_begin and nor_end every frequency shares
+     * @return ms, 0 when it would be shorter than half a sample
+     */
+    float GetBulkDelayMs(const mana::CurveV2::Snapshot& curve, float max_delay_ms, float nor_begin, float nor_end) const {
+        auto min_ms = std::max(0.0f, curve.GetMinimum(nor_begin, nor_end) * max_delay_ms);
+        auto bulk_ms = bulk_delay_ms_ < 0.0f ? min_ms : std::min(bulk_delay_ms_, min_ms);
+        bulk_ms = std::min(bulk_ms, kMaxBulkDelayMs);
+        if (bulk_ms * sample_rate_ / 1000.0f < 0.5f) {
+            return 0.0f;
+        }
+        return bulk_ms;
+    }
+
+    inline float GetPoleRadius(float bw) const {
+        float ret{};
+        if (bw < 0.01f) {
+            ret = (1.0f - magic_beta_ * (0.5f * (bw)));
+        }
+        else {
+            auto n = (1.0f - beta_ * std::cos(-bw * 0.5f)) / (1.0f - beta_);
+            ret =  (n - std::sqrt(n * n - 1));
+        }
+        return std::min(std::max(0.0f, ret), 0.999995f);
+    }
+
+    // sections
+    std::vector<float> center_;
+    std::vector<float> radius_;
+    std::vector<float> bw_;
+    std::vector<size_t> end_step_;
+    std::vector<float> carry_;
+
+    // phase of every resolution step and its prefix sum
+    std::vector<float> steps_;
+    std::vector<float> new_steps_;
+    std::vector<double> phase_;
+    // curve position of every step, only changes with the frequency range
+    std::vector<float> step_nor_;
+    StepGrid step_grid_;
+
+    std::vector<float> run_center_;
+    std::vector<float> run_radius_;
+    std::vector<float> run_bw_;
+    std::vector<size_t> run_end_step_;
+    std::vector<float> run_carry_;
+
+    std::vector<float> grid_;
+    GroupDelayGrid analysis_grid_;
+    std::vector<double> analysis_;
+
+    Layout layout_;
+    bool valid_{};
+    bool full_design_{};
+    float freq_interval_{};
+    float bulk_ms_{};
+
+    float sample_rate_{ 48000.0f };
+    float beta_{ 0.5f }; // 最大群延迟的分数延迟
+    float magic_beta_{};
+    float min_bw_hz_{};
+    float min_bw_{};
+    float bulk_delay_ms_{ kAutoBulkDelay };
+};
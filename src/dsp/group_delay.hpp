@@ -0,0 +1,111 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <xsimd/xsimd.hpp>
+#include "simd_arch.hpp"
+
+/*
+* summed group delay of second order allpass sections over a fixed frequency grid.
+* with the poles at r * e^(+-j theta) every pole adds
+*   (1 - r^2) / ((1 - r)^2 + 4r sin^2((w -+ theta) / 2))
+* and sin((w -+ theta) / 2) is a difference of products of the half angle sin/cos of the grid
+* and of the section. those are taken once, so the kernel is only multiply, add and one divide
+* per section and point: simd lanes run across grid points and every section is summed into them.
+*/
+class GroupDelayGrid {
+public:
+    // sections reduced per kernel call, their constants stay in L1
+    static constexpr size_t kSectionTile = 256;
+    // grid is padded to the widest batch
+    static constexpr size_t kPointAlign = 16;
+
+    struct Block {
+        const float* sin_w;
+        const float* cos_w;
+        size_t num_points;
+        const float* sin_theta;
+        const float* cos_theta;
+        const float* a;
+        const float* b;
+        const float* k;
+        size_t num_sections;
+        float* out;
+    };
+    using BlockProcessFn = void(*)(const Block& block);
+
+    /**
+     * @brief kernels are compiled once per ISA in group_delay_<isa>.cpp
+     *        see group_delay_kernel.hpp
+     */
+    template<class Arch>
+    static void ProcessBlock(const Block& block);
+
+    /**
+     * @brief allocates
+     * @param w 0~pi
+     */
+    void SetGrid(const std::vector<float>& w) {
+        num_points_ = w.size();
+        auto padded = (num_points_ + kPointAlign - 1) / kPointAlign * kPointAlign;
+        sin_w_.assign(padded, 0.0f);
+        cos_w_.assign(padded, 0.0f);
+        for (size_t i = 0; i < num_points_; ++i) {
+            sin_w_[i] = static_cast<float>(std::sin(0.5 * w[i]));
+            cos_w_[i] = static_cast<float>(std::cos(0.5 * w[i]));
+        }
+        sum_.assign(padded, 0.0f);
+        process_ = xsimd::dispatch<SimdArchList>([]<class Arch>(Arch) -> BlockProcessFn {
+            return &GroupDelayGrid::ProcessBlock<Arch>;
+        })();
+    }
+
+    size_t GetNumPoints() const {
+        return num_points_;
+    }
+
+    /**
+     * @brief out[i] += sign * the group delay of all sections at grid point i, samples. does not allocate
+     */
+    void Accumulate(const float* theta, const float* radius, size_t num_sections, double* out, double sign = 1.0) {
+        if (process_ == nullptr) {
+            return;
+        }
+
+        for (size_t begin = 0; begin < num_sections; begin += kSectionTile) {
+            auto num = std::min(kSectionTile, num_sections - begin);
+            for (size_t j = 0; j < num; ++j) {
+                double half = 0.5 * theta[begin + j];
+                double r = radius[begin + j];
+                sin_theta_[j] = static_cast<float>(std::sin(half));
+                cos_theta_[j] = static_cast<float>(std::cos(half));
+                a_[j] = static_cast<float>((1.0 - r) * (1.0 - r));
+                b_[j] = static_cast<float>(4.0 * r);
+                k_[j] = static_cast<float>(1.0 - r * r);
+            }
+            process_(Block{
+                sin_w_.data(), cos_w_.data(), sin_w_.size(),
+                sin_theta_, cos_theta_, a_, b_, k_, num,
+                sum_.data()
+            });
+            for (size_t i = 0; i < num_points_; ++i) {
+                out[i] += sign * sum_[i];
+            }
+        }
+    }
+private:
+    size_t num_points_{};
+    std::vector<float, xsimd::aligned_allocator<float, 64>> sin_w_;
+    std::vector<float, xsimd::aligned_allocator<float, 64>> cos_w_;
+    std::vector<float, xsimd::aligned_allocator<float, 64>> sum_;
+    float sin_theta_[kSectionTile]{};
+    float cos_theta_[kSectionTile]{};
+    float a_[kSectionTile]{};
+    float b_[kSectionTile]{};
+    float k_[kSectionTile]{};
+    BlockProcessFn process_{};
+};
+
+extern template void GroupDelayGrid::ProcessBlock<xsimd::sse2>(const Block&);
+extern template void GroupDelayGrid::ProcessBlock<xsimd::avx2>(const Block&);
+extern template void GroupDelayGrid::ProcessBlock<xsimd::avx512f>(const Block&);
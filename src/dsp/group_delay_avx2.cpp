@@ -0,0 +1,3 @@
+#include "group_delay_kernel.hpp"
+
+template void GroupDelayGrid::ProcessBlock<xsimd::avx2>(const Block&);
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+#include "group_delay.hpp"
+
+/*
+* only include this in the group_delay_<isa>.cpp files, same rules as stack_allpass_kernel.hpp
+*/
+
+template<class Arch>
+void GroupDelayGrid::ProcessBlock(const Block& block) {
+    using batch = xsimd::batch<float, Arch>;
+    constexpr size_t kLanes = batch::size;
+
+    for (size_t p = 0; p < block.num_points; p += kLanes) {
+        auto sw = batch::load_aligned(block.sin_w + p);
+        auto cw = batch::load_aligned(block.cos_w + p);
+        batch acc(0.0f);
+        for (size_t j = 0; j < block.num_sections; ++j) {
+            auto cross = cw * block.sin_theta[j];
+            // sin((w - theta) / 2), sin((w + theta) / 2)
+            auto lower = xsimd::fms(sw, batch(block.cos_theta[j]), cross);
+            auto upper = xsimd::fma(sw, batch(block.cos_theta[j]), cross);
+            const batch a(block.a[j]);
+            const batch b(block.b[j]);
+            auto den_lower = xsimd::fma(b, lower * lower, a);
+            auto den_upper = xsimd::fma(b, upper * upper, a);
+            // k / lower + k / upper with one divide
+            acc += block.k[j] * (den_lower + den_upper) / (den_lower * den_upper);
+        }
+        acc.store_aligned(block.out + p);
+    }
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
+#include <functional>
 
 namespace mana::utli {
 template<class Listener>
@@ -0,0 +1,272 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <memory>
+#include <algorithm>
+#include "real_fft.hpp"
+
+/*
+* zero latency uniformly partitioned convolution.
+* the first block of the impulse response runs as a direct fir, the rest is split into
+* block sized partitions that run in the frequency domain through a frequency delay line.
+* the block latency of the fft part is hidden because its partitions start one block late.
+* the transformed impulse response is an immutable Filter, engines of every channel can run the same one
+*/
+class PartitionedConvolution {
+public:
+    static constexpr int kDefaultBlockSize = 256;
+
+    struct Filter {
+        size_t block_size{};
+        size_t num_partitions{};
+        size_t length{};
+        // first block, reversed
+        std::vector<float> head;
+        std::vector<float> ir_re;
+        std::vector<float> ir_im;
+
+        /**
+         * @brief Assign up to max_length samples will not allocate
+         */
+        void Reserve(size_t max_length, int block) {
+            block_size = static_cast<size_t>(block);
+            fft.Init(2 * block_size);
+            auto max_partitions = max_length > block_size ? (max_length - 1) / block_size : 0;
+            head.resize(block_size);
+            frame.resize(2 * block_size);
+            ir_re.reserve(max_partitions * fft.GetNumBins());
+            ir_im.reserve(max_partitions * fft.GetNumBins());
+        }
+
+        /**
+         * @brief partitions and transforms the impulse response, call Reserve first
+         */
+        void Assign(const float* ir, size_t ir_length) {
+            length = ir_length;
+            // stored reversed, so the fir is a dot product with the history
+            std::ranges::fill(head, 0.0f);
+            for (size_t i = 0; i < std::min(length, block_size); ++i) {
+                head[block_size - 1 - i] = ir[i];
+            }
+
+            auto num_bins = fft.GetNumBins();
+            num_partitions = length > block_size ? (length - 1) / block_size : 0;
+            ir_re.resize(num_partitions * num_bins);
+            ir_im.resize(num_partitions * num_bins);
+            for (size_t p = 0; p < num_partitions; ++p) {
+                std::ranges::fill(frame, 0.0f);
+                auto begin = block_size + p * block_size;
+                auto end = std::min(length, begin + block_size);
+                std::copy(ir + begin, ir + end, frame.begin());
+                fft.Forward(frame.data(), ir_re.data() + p * num_bins, ir_im.data() + p * num_bins);
+            }
+        }
+    private:
+        RealFft fft;
+        std::vector<float> frame;
+    };
+
+    /**
+     * @brief not real time safe
+     * @param block_size of the engines that run it
+     */
+    static std::shared_ptr<const Filter> CreateFilter(const float* ir, size_t length, int block_size) {
+        auto filter = std::make_shared<Filter>();
+        filter->Reserve(length, block_size);
+        filter->Assign(ir, length);
+        return filter;
+    }
+
+    /**
+     * @brief allocates, drops the impulse response
+     * @param block_size rounded up to a power of two
+     */
+    void Init(int block_size) {
+        block_size_ = 16;
+        while (block_size_ < static_cast<size_t>(block_size)) {
+            block_size_ <<= 1;
+        }
+        fft_.Init(2 * block_size_);
+        filter_.reset();
+        history_.assign(2 * block_size_, 0.0f);
+        input_.assign(2 * block_size_, 0.0f);
+        output_.assign(block_size_, 0.0f);
+        frame_.assign(2 * block_size_, 0.0f);
+        acc_re_.assign(fft_.GetNumBins(), 0.0f);
+        acc_im_.assign(fft_.GetNumBins(), 0.0f);
+        fdl_re_.clear();
+        fdl_im_.clear();
+        Reset();
+    }
+
+    int GetBlockSize() const {
+        return static_cast<int>(block_size_);
+    }
+
+    /**
+     * @brief filters up to max_length samples can be set without allocating
+     */
+    void Reserve(size_t max_length) {
+        auto max_partitions = max_length > block_size_ ? (max_length - 1) / block_size_ : 0;
+        fdl_re_.reserve(max_partitions * fft_.GetNumBins());
+        fdl_im_.reserve(max_partitions * fft_.GetNumBins());
+    }
+
+    /**
+     * @brief sizes the frequency delay line, only allocates past Reserve. the filter must be
+     *        made for this block size, the running state is cleared
+     */
+    void SetFilter(std::shared_ptr<const Filter> filter) {
+        filter_ = std::move(filter);
+        auto size = filter_->num_partitions * fft_.GetNumBins();
+        fdl_re_.assign(size, 0.0f);
+        fdl_im_.assign(size, 0.0f);
+        Reset();
+    }
+
+    /**
+     * @brief not real time safe, a filter of its own
+     */
+    void SetImpulseResponse(const float* ir, size_t length) {
+        SetFilter(CreateFilter(ir, length, static_cast<int>(block_size_)));
+    }
+
+    const std::shared_ptr<const Filter>& GetFilter() const {
+        return filter_;
+    }
+
+    size_t GetLength() const {
+        return filter_ != nullptr ? filter_->length : 0;
+    }
+
+    /**
+     * @brief flops per sample, same unit as the allpass estimate in SDelay
+     */
+    static float EstimateCost(size_t ir_length, int block_size) {
+        auto b = static_cast<float>(block_size);
+        auto num_partitions = ir_length > static_cast<size_t>(block_size)
+            ? std::ceil((ir_length - b) / b) : 0.0f;
+        // fir head, forward + inverse fft (5 n log2 n each), complex mac per bin and partition
+        auto fir = 2.0f * b;
+        auto fft = num_partitions > 0.0f ? 2.0f * 5.0f * 2.0f * b * std::log2(2.0f * b) / b : 0.0f;
+        auto mac = 8.0f * num_partitions * (b + 1.0f) / b;
+        return fir + fft + mac;
+    }
+
+    void Process(float* io, int num_samples) {
+        if (filter_ == nullptr) {
+            return;
+        }
+
+        const auto* head = filter_->head.data();
+        for (int n = 0; n < num_samples; ++n) {
+            auto x = io[n];
+
+            history_[history_pos_] = x;
+            history_[history_pos_ + block_size_] = x;
+            ++history_pos_;
+            if (history_pos_ == block_size_) {
+                history_pos_ = 0;
+            }
+            const auto* window = history_.data() + history_pos_;
+            float y = 0.0f;
+            for (size_t i = 0; i < block_size_; ++i) {
+                y += head[i] * window[i];
+            }
+
+            input_[block_size_ + block_pos_] = x;
+            y += output_[block_pos_];
+            io[n] = y;
+
+            ++block_pos_;
+            if (block_pos_ == block_size_) {
+                block_pos_ = 0;
+                ProcessPartitions();
+            }
+        }
+    }
+
+    /**
+     * @brief exchange the running input history with another engine of the same block size,
+     *        the frequency delay line only moves when both run filters with the same number of partitions
+     */
+    void SwapState(PartitionedConvolution& other) {
+        if (block_size_ != other.block_size_) {
+            return;
+        }
+        std::swap(history_, other.history_);
+        std::swap(history_pos_, other.history_pos_);
+        std::swap(input_, other.input_);
+        std::swap(output_, other.output_);
+        std::swap(block_pos_, other.block_pos_);
+        if (GetNumPartitions() == other.GetNumPartitions()) {
+            std::swap(fdl_re_, other.fdl_re_);
+            std::swap(fdl_im_, other.fdl_im_);
+            std::swap(fdl_pos_, other.fdl_pos_);
+        }
+    }
+
+    void Reset() {
+        std::ranges::fill(history_, 0.0f);
+        std::ranges::fill(input_, 0.0f);
+        std::ranges::fill(output_, 0.0f);
+        std::ranges::fill(fdl_re_, 0.0f);
+        std::ranges::fill(fdl_im_, 0.0f);
+        history_pos_ = 0;
+        block_pos_ = 0;
+        fdl_pos_ = 0;
+    }
+private:
+    size_t GetNumPartitions() const {
+        return filter_ != nullptr ? filter_->num_partitions : 0;
+    }
+
+    void ProcessPartitions() {
+        const auto num_partitions = GetNumPartitions();
+        if (num_partitions == 0) {
+            return;
+        }
+
+        auto num_bins = fft_.GetNumBins();
+        // overlap save, the frame is the last two blocks of input
+        fft_.Forward(input_.data(), fdl_re_.data() + fdl_pos_ * num_bins, fdl_im_.data() + fdl_pos_ * num_bins);
+        std::copy(input_.begin() + block_size_, input_.end(), input_.begin());
+
+        std::ranges::fill(acc_re_, 0.0f);
+        std::ranges::fill(acc_im_, 0.0f);
+        auto slot = fdl_pos_;
+        for (size_t p = 0; p < num_partitions; ++p) {
+            const auto* x_re = fdl_re_.data() + slot * num_bins;
+            const auto* x_im = fdl_im_.data() + slot * num_bins;
+            const auto* h_re = filter_->ir_re.data() + p * num_bins;
+            const auto* h_im = filter_->ir_im.data() + p * num_bins;
+            for (size_t k = 0; k < num_bins; ++k) {
+                acc_re_[k] += x_re[k] * h_re[k] - x_im[k] * h_im[k];
+                acc_im_[k] += x_re[k] * h_im[k] + x_im[k] * h_re[k];
+            }
+            slot = slot == 0 ? num_partitions - 1 : slot - 1;
+        }
+        fdl_pos_ = fdl_pos_ + 1 == num_partitions ? 0 : fdl_pos_ + 1;
+
+        fft_.Inverse(acc_re_.data(), acc_im_.data(), frame_.data());
+        std::copy(frame_.begin() + block_size_, frame_.end(), output_.begin());
+    }
+
+    RealFft fft_;
+    size_t block_size_{};
+    std::shared_ptr<const Filter> filter_;
+
+    std::vector<float> history_;
+    size_t history_pos_{};
+
+    std::vector<float> input_;
+    std::vector<float> output_;
+    std::vector<float> frame_;
+    size_t block_pos_{};
+
+    std::vector<float> fdl_re_;
+    std::vector<float> fdl_im_;
+    size_t fdl_pos_{};
+    std::vector<float> acc_re_;
+    std::vector<float> acc_im_;
+};
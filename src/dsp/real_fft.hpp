@@ -0,0 +1,138 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <numbers>
+
+/*
+* power of two real fft. the real signal is packed into a complex fft of half the size,
+* spectra are split into real and imaginary arrays of size / 2 + 1 bins
+*/
+class RealFft {
+public:
+    void Init(size_t size) {
+        size_ = size;
+        half_ = size / 2;
+
+        size_t bits = 0;
+        while ((size_t{ 1 } << bits) < half_) {
+            ++bits;
+        }
+        bit_reverse_.resize(half_);
+        for (size_t i = 0; i < half_; ++i) {
+            size_t r = 0;
+            for (size_t b = 0; b < bits; ++b) {
+                r |= ((i >> b) & 1) << (bits - 1 - b);
+            }
+            bit_reverse_[i] = r;
+        }
+
+        constexpr auto twopi = std::numbers::pi_v<double> * 2;
+        // exp(-j2pi k / half) for the complex passes, exp(-j2pi k / size) to split the packed spectrum
+        twiddle_re_.resize(half_ / 2 + 1);
+        twiddle_im_.resize(half_ / 2 + 1);
+        for (size_t k = 0; k < twiddle_re_.size(); ++k) {
+            twiddle_re_[k] = static_cast<float>(std::cos(twopi * k / half_));
+            twiddle_im_[k] = static_cast<float>(-std::sin(twopi * k / half_));
+        }
+        split_re_.resize(half_ + 1);
+        split_im_.resize(half_ + 1);
+        for (size_t k = 0; k <= half_; ++k) {
+            split_re_[k] = static_cast<float>(std::cos(twopi * k / size_));
+            split_im_[k] = static_cast<float>(-std::sin(twopi * k / size_));
+        }
+        work_re_.resize(half_);
+        work_im_.resize(half_);
+    }
+
+    size_t GetSize() const {
+        return size_;
+    }
+
+    size_t GetNumBins() const {
+        return half_ + 1;
+    }
+
+    /**
+     * @param input size samples
+     * @param re size / 2 + 1 bins
+     * @param im size / 2 + 1 bins
+     */
+    void Forward(const float* input, float* re, float* im) {
+        for (size_t n = 0; n < half_; ++n) {
+            work_re_[bit_reverse_[n]] = input[2 * n];
+            work_im_[bit_reverse_[n]] = input[2 * n + 1];
+        }
+        Butterflies(false);
+
+        for (size_t k = 0; k <= half_; ++k) {
+            auto k0 = k == half_ ? 0 : k;
+            auto k1 = k == 0 ? 0 : half_ - k;
+            // even = (Z[k] + Z*[-k]) / 2, odd = (Z[k] - Z*[-k]) / 2j
+            auto even_re = 0.5f * (work_re_[k0] + work_re_[k1]);
+            auto even_im = 0.5f * (work_im_[k0] - work_im_[k1]);
+            auto odd_re = 0.5f * (work_im_[k0] + work_im_[k1]);
+            auto odd_im = -0.5f * (work_re_[k0] - work_re_[k1]);
+            re[k] = even_re + split_re_[k] * odd_re - split_im_[k] * odd_im;
+            im[k] = even_im + split_re_[k] * odd_im + split_im_[k] * odd_re;
+        }
+    }
+
+    /**
+     * @brief scaled by 1 / size, so Inverse(Forward(x)) == x
+     */
+    void Inverse(const float* re, const float* im, float* output) {
+        for (size_t k = 0; k < half_; ++k) {
+            auto k1 = half_ - k;
+            auto even_re = 0.5f * (re[k] + re[k1]);
+            auto even_im = 0.5f * (im[k] - im[k1]);
+            auto diff_re = 0.5f * (re[k] - re[k1]);
+            auto diff_im = 0.5f * (im[k] + im[k1]);
+            // odd = diff * conj(twiddle)
+            auto odd_re = diff_re * split_re_[k] + diff_im * split_im_[k];
+            auto odd_im = diff_im * split_re_[k] - diff_re * split_im_[k];
+            // Z = even + j * odd, bit reversed for the inverse passes
+            work_re_[bit_reverse_[k]] = even_re - odd_im;
+            work_im_[bit_reverse_[k]] = even_im + odd_re;
+        }
+        Butterflies(true);
+
+        auto scale = 1.0f / half_;
+        for (size_t n = 0; n < half_; ++n) {
+            output[2 * n] = work_re_[n] * scale;
+            output[2 * n + 1] = work_im_[n] * scale;
+        }
+    }
+private:
+    void Butterflies(bool inverse) {
+        auto sign = inverse ? -1.0f : 1.0f;
+        for (size_t len = 2; len <= half_; len <<= 1) {
+            auto half_len = len / 2;
+            auto step = half_ / len;
+            for (size_t i = 0; i < half_; i += len) {
+                for (size_t j = 0; j < half_len; ++j) {
+                    auto w_re = twiddle_re_[j * step];
+                    auto w_im = twiddle_im_[j * step] * sign;
+
+                    auto a = i + j;
+                    auto b = a + half_len;
+                    auto t_re = work_re_[b] * w_re - work_im_[b] * w_im;
+                    auto t_im = work_re_[b] * w_im + work_im_[b] * w_re;
+                    work_re_[b] = work_re_[a] - t_re;
+                    work_im_[b] = work_im_[a] - t_im;
+                    work_re_[a] += t_re;
+                    work_im_[a] += t_im;
+                }
+            }
+        }
+    }
+
+    size_t size_{};
+    size_t half_{};
+    std::vector<size_t> bit_reverse_;
+    std::vector<float> twiddle_re_;
+    std::vector<float> twiddle_im_;
+    std::vector<float> split_re_;
+    std::vector<float> split_im_;
+    std::vector<float> work_re_;
+    std::vector<float> work_im_;
+};
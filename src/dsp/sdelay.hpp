@@ -1,231 +1,323 @@
 #pragma once
 #include <vector>
-#include <numbers>
+#include <memory>
+#include <variant>
 #include "stack_allpass.hpp"
-#include "convert.hpp"
-#include "curve_v2.h"
+#include "bulk_delay.hpp"
+#include "partitioned_convolution.hpp"
+#include "delay_design.hpp"
+#include "allpass_bank.hpp"
 
+/*
+* one channel of the delay. the coefficients are an AllPassBank that other channels may
+* run as well, only the filter state, the bulk line and the convolution history are its own
+*/
 class SDelay {
 public:
-    using Filter = StackAllPassFilter;
+    template<size_t N>
+    using Filter = StackAllPassFilter<N>;
+    using Schedule = StackSchedule;
+    using Engine = AllPassBank::Engine;
+    static constexpr size_t kMaxNumStack = 32;
+    static constexpr int kDefaultTileSize = 64;
+    static constexpr float kMaxBulkDelayMs = DelayDesign::kMaxBulkDelayMs;
+    static constexpr float kMaxImpulseResponseMs = AllPassBank::kMaxImpulseResponseMs;
+    static constexpr float kDefaultImpulseThresholdDb = AllPassBank::kDefaultImpulseThresholdDb;
+    static constexpr float kAllPassSectionCost = AllPassBank::kAllPassSectionCost;
 
     SDelay() {
-        filters_.reserve(512);
-        magic_beta_ = std::sqrt(beta_ / (1 - beta_));
+        SetNumStack(8);
+        convolution_.Init(PartitionedConvolution::kDefaultBlockSize);
     }
 
-    void PrepareProcess(float sample_rate) {
-        sample_rate_ = sample_rate;
+    /**
+     * @param max_bulk_delay_ms longest bulk delay of the banks it will run
+     */
+    void PrepareProcess(float sample_rate, float max_bulk_delay_ms = kMaxBulkDelayMs) {
+        SetNumStack(GetSimdWidth());
+        max_bulk_delay_ms = std::min(max_bulk_delay_ms, kMaxBulkDelayMs);
+        bulk_delay_.Init(static_cast<size_t>(std::ceil(max_bulk_delay_ms * sample_rate / 1000.0f)));
+        convolution_.Init(PartitionedConvolution::kDefaultBlockSize);
+        options_.convolution_block_size = convolution_.GetBlockSize();
+        bank_.reset();
     }
 
-    void Process(float* input, int num_samples) {
-        for (size_t i = 0; i < add_filter_counter_; ++i) {
-            filters_[i].Process(input, num_samples);
+    /**
+     * @brief filters per stack, 4/8/16/32. drops the current bank when it changes
+     */
+    void SetNumStack(size_t num_stack) {
+        if (num_stack != 4 && num_stack != 16 && num_stack != 32) {
+            num_stack = 8;
+        }
+        if (num_stack == options_.num_stack) {
+            return;
         }
+        options_.num_stack = num_stack;
+        bank_.reset();
     }
 
-    void PaincFilterFb() {
-        for (auto& f : filters_) {
-            f.PaincFb();
-        }
+    /**
+     * @brief serial or wavefront kernel, both give the same output and keep the filter state
+     */
+    void SetSchedule(Schedule schedule) {
+        schedule_ = schedule;
+        std::visit([this]<size_t N>(Cascade<N>& cascade) {
+            cascade.process = Filter<N>::SelectBlockProcess(schedule_);
+        }, cascade_);
+    }
+
+    size_t GetNumStack() const {
+        return options_.num_stack;
     }
 
     /**
-     * @brief 
-     * @param curve unit: ms
-     * @param f_begin 0~1
-     * @param f_end 0~1
-     */
-    void SetCurvePitchAxis(mana::CurveV2& curve, int resulotion, float max_delay_ms, float p_begin, float p_end) {
-        constexpr auto twopi = std::numbers::pi_v<float> * 2;
-        float intergal = 0.0f;
-        auto freq_begin_hz = SemitoneMap(p_begin);
-        auto freq_end_hz = freq_begin_hz;
-        const auto real_freq_end_hz = SemitoneMap(p_end);
-        auto freq_interval_hz = (real_freq_end_hz - freq_begin_hz) / resulotion;
-        auto nor_freq_interval = freq_interval_hz / sample_rate_ * twopi;
-        auto nor_freq_begin = freq_begin_hz / sample_rate_ * twopi;
-
-        ClearFilters();
-        for (size_t i = 0; i < resulotion;) {
-            while (intergal < twopi && i < resulotion) {
-                auto st = Hz2Semitone(freq_end_hz);
-                auto nor = (st - s_st_begin) / (s_st_end - s_st_begin);
-                nor = std::clamp(nor, 0.0f, 1.0f);
-                auto delay_ms = curve.GetNormalize(nor) * max_delay_ms;
-                auto delay_samples = delay_ms * sample_rate_ / 1000.0f;
-                intergal += nor_freq_interval * delay_samples;
-                freq_end_hz += freq_interval_hz;
-                ++i;
-            }
+     * @brief samples pushed through all filters at once, small enough to stay in L1
+     */
+    void SetTileSize(int tile_size) {
+        tile_size_ = std::max(1, tile_size);
+    }
 
-            while (intergal > twopi) {
-                intergal -= twopi;
-            }
+    int GetTileSize() const {
+        return tile_size_;
+    }
 
-            if (i >= resulotion && intergal < twopi) {
-                freq_end_hz = real_freq_end_hz;
-            }
-            auto freq_end = freq_end_hz / sample_rate_ * twopi;
-            auto freq_begin = freq_begin_hz / sample_rate_ * twopi;
+    /**
+     * @brief takes effect on the next design
+     */
+    void SetEngine(Engine engine) {
+        options_.engine = engine;
+    }
+
+    /**
+     * @brief energy left out when the impulse response is truncated, relative to the energy rendered before it
+     */
+    void SetImpulseThreshold(float db) {
+        options_.impulse_threshold = std::pow(10.0f, db / 10.0f);
+    }
 
-            // 创建全通滤波器?
-            auto center = freq_begin + (freq_end - freq_begin) / 2.0f;
-            auto bw = freq_end - freq_begin;
+    bool IsConvolutionActive() const {
+        return bank_ != nullptr && bank_->GetConvolution() != nullptr;
+    }
 
-            if (bw > min_bw_) {
-                auto pole_radius = GetPoleRadius(bw);
-                AddFilter(center, pole_radius, bw);
-                freq_begin_hz = freq_end_hz;
-            }
+    /**
+     * @brief flops per sample of running the designed sections
+     */
+    float EstimateAllPassCost() const {
+        return GetNumFilters() * kAllPassSectionCost;
+    }
+
+    /**
+     * @brief flops per sample of convolving with the rendered impulse response
+     * @param ir_length samples
+     */
+    float EstimateConvolutionCost(size_t ir_length) const {
+        return PartitionedConvolution::EstimateCost(ir_length, convolution_.GetBlockSize());
+    }
+
+    /**
+     * @brief impulse response of the designed sections without the bulk delay, does not touch the running state
+     * @param max_length samples
+     * @return false when it was cut at max_length before it decayed
+     */
+    bool RenderImpulseResponse(std::vector<float>& ir, size_t max_length) const {
+        ir.clear();
+        return bank_ == nullptr || bank_->RenderImpulseResponse(ir, max_length);
+    }
+
+    void Process(float* input, int num_samples) {
+        if (bank_ == nullptr) {
+            bulk_delay_.Process(input, num_samples);
+            return;
+        }
+        if (bank_->GetConvolution() != nullptr) {
+            convolution_.Process(input, num_samples);
+            bulk_delay_.Process(input, num_samples);
+            return;
         }
-        EndAddFilter();
-    }
-
-    /**
-     * @brief 
-     * @param curve 
-     * @param resulotion 
-     * @param max_delay_ms 
-     * @param f_begin 0~pi
-     * @param f_end 0~pi
-     */
-    void SetCurve(mana::CurveV2& curve, int resulotion, float max_delay_ms, float f_begin, float f_end) {
-        constexpr auto twopi = std::numbers::pi_v<float> *2;
-        float intergal = 0.0f;
-        auto freq_begin = f_begin;
-        auto freq_end = f_begin;
-        auto freq_interval = (f_end - f_begin) / resulotion;
-
-        ClearFilters();
-        for (size_t i = 0; i < resulotion;) {
-            while (intergal < twopi && i < resulotion) {
-                auto nor = i / (resulotion - 1.0f);
-                auto delay_ms = curve.GetNormalize(nor) * max_delay_ms;
-                auto delay_samples = delay_ms * sample_rate_ / 1000.0f;
-                intergal += freq_interval * delay_samples;
-                freq_end += freq_interval;
-                ++i;
-            }
 
-            while (intergal > twopi) {
-                intergal -= twopi;
+        std::visit([&]<size_t N>(Cascade<N>& cascade) {
+            const auto& filters = bank_->GetFilters<N>();
+            for (int offset = 0; offset < num_samples; offset += tile_size_) {
+                auto num_tile = std::min(tile_size_, num_samples - offset);
+                cascade.process(filters.data(), cascade.states.data(), filters.size(), input + offset, num_tile);
             }
+        }, cascade_);
+        bulk_delay_.Process(input, num_samples);
+    }
 
-            if (i >= resulotion && intergal < twopi) {
-                freq_end = f_end;
-            }
+    /**
+     * @brief take over the running state of the channel this one replaces, no allocation.
+     *        both banks are in frequency order, a section that is in both gets its own
+     *        state back, a new one the state of its neighbour. the bulk line is swapped
+     */
+    void TakeStateFrom(SDelay& other) {
+        if (bank_ != nullptr && other.bank_ != nullptr && cascade_.index() == other.cascade_.index()) {
+            std::visit([&]<size_t N>(Cascade<N>& cascade) {
+                const auto& other_cascade = std::get<Cascade<N>>(other.cascade_);
+                const auto& bank = *bank_;
+                const auto& other_bank = *other.bank_;
+                const auto num_other = other_bank.GetNumFilters();
+                if (num_other == 0) {
+                    return;
+                }
 
-            // 创建一个全通滤波器
-            auto center = freq_begin + (freq_end - freq_begin) / 2.0f;
-            auto bw = freq_end - freq_begin;
-            if (bw > min_bw_) {
-                auto pole_radius = GetPoleRadius(bw);
-                AddFilter(center, pole_radius, bw);
-                freq_begin = freq_end;
-            }
+                size_t j = 0;
+                for (size_t i = 0; i < bank.GetNumFilters(); ++i) {
+                    auto t = bank.GetTheta(i);
+                    while (j + 1 < num_other && other_bank.GetTheta(j) < t) {
+                        ++j;
+                    }
+                    cascade.states[i / N].CopyState(i % N, other_cascade.states[j / N], j % N);
+                    if (other_bank.GetTheta(j) == t && j + 1 < num_other) {
+                        ++j;
+                    }
+                }
+            }, cascade_);
         }
-        EndAddFilter();
-    }
-
-    void SetMinBw(float bw) {
-        constexpr auto twopi = std::numbers::pi_v<float> * 2;
-        min_bw_ = bw / sample_rate_ * twopi;
-    }
-
-    void SetBeta(float beta) {
-        beta_ = beta;
-        magic_beta_ = std::sqrt(beta_ / (1 - beta_));
-
-        for (size_t i = 0; i < add_filter_counter_; ++i) {
-            auto& f = filters_[i];
-            float center[Filter::kNumStack]{
-                f.GetTheta(0), f.GetTheta(1), f.GetTheta(2), f.GetTheta(3), f.GetTheta(4), f.GetTheta(5), f.GetTheta(6), f.GetTheta(7)
-            };
-            float bw[Filter::kNumStack]{
-                f.GetBw(0), f.GetBw(1), f.GetBw(2), f.GetBw(3), f.GetBw(4), f.GetBw(5), f.GetBw(6), f.GetBw(7)
-            };
-            float radius[Filter::kNumStack]{
-                GetPoleRadius(bw[0]), GetPoleRadius(bw[1]), GetPoleRadius(bw[2]), GetPoleRadius(bw[3]), GetPoleRadius(bw[4]), GetPoleRadius(bw[5]), GetPoleRadius(bw[6]), GetPoleRadius(bw[7])
-            };
-            f.Set(center, radius, bw);
+        bulk_delay_.SwapLine(other.bulk_delay_);
+        if (IsConvolutionActive() && other.IsConvolutionActive()) {
+            convolution_.SwapState(other.convolution_);
         }
     }
 
-    float GetGroupDelay(float w) const {
-        float delay = 0.0f;
-        for (size_t i = 0; i < add_filter_counter_; ++i) {
-            delay += filters_[i].GetGroupDelay(w);
-        }
-        return delay;
+    void PaincFilterFb() {
+        std::visit([]<size_t N>(Cascade<N>& cascade) {
+            for (auto& s : cascade.states) {
+                s.PaincFb();
+            }
+        }, cascade_);
+        convolution_.Reset();
+        bulk_delay_.Reset();
     }
 
-    size_t GetNumFilters() const {
-        return add_filter_counter_ * Filter::kNumStack;
+    /**
+     * @return samples
+     */
+    float GetBulkDelay() const {
+        return bulk_delay_.GetDelay();
     }
-private:
-    inline float GetPoleRadius(float bw) const {
-        float ret{};
-        if (bw < 0.01f) {
-            ret = (1.0f - magic_beta_ * (0.5f * (bw)));
+
+    /**
+     * @brief pack a design with the settings of this channel and run it
+     * @return the bank, other channels can run it with SetBank
+     */
+    std::shared_ptr<const AllPassBank> SetDesign(const DelayDesign& design) {
+        auto bank = AllPassBank::Create(design, options_);
+        SetBank(bank);
+        return bank;
+    }
+
+    /**
+     * @brief not real time safe. run a bank that may be shared with other channels, the
+     *        state of the filters already running stays
+     */
+    void SetBank(std::shared_ptr<const AllPassBank> bank) {
+        bank_ = std::move(bank);
+        switch (bank_->GetNumStack()) {
+        case 4:
+            ResizeCascade<4>();
+            break;
+        case 16:
+            ResizeCascade<16>();
+            break;
+        case 32:
+            ResizeCascade<32>();
+            break;
+        default:
+            ResizeCascade<8>();
+            break;
         }
-        else {
-            auto n = (1.0f - beta_ * std::cos(-bw * 0.5f)) / (1.0f - beta_);
-            ret =  (n - std::sqrt(n * n - 1));
+        bulk_delay_.SetDelay(bank_->GetBulkDelay());
+        if (bank_->GetConvolution() != nullptr) {
+            // shares the ownership of the bank, no allocation
+            convolution_.SetFilter(std::shared_ptr<const PartitionedConvolution::Filter>(bank_, bank_->GetConvolution()));
         }
-        return std::min(std::max(0.0f, ret), 0.999995f);
     }
 
-    inline void AddFilter(float center, float radius, float bw) {
-        if (stack_filter_counter_ == Filter::kNumStack) {
-            if (add_filter_counter_ < filters_.size()) {
-                filters_[add_filter_counter_].Set(center_, radius_, bw_);
-                ++add_filter_counter_;
-            }
-            else {
-                filters_.emplace_back(center_, radius_, bw_);
-                ++add_filter_counter_;
-            }
-            stack_filter_counter_ = 0;
+    /**
+     * @brief after this SetBank with banks of up to max_sections does not allocate
+     * @param max_impulse_length samples
+     */
+    void Reserve(size_t max_sections, size_t max_impulse_length) {
+        switch (options_.num_stack) {
+        case 4:
+            ReserveCascade<4>(max_sections);
+            break;
+        case 16:
+            ReserveCascade<16>(max_sections);
+            break;
+        case 32:
+            ReserveCascade<32>(max_sections);
+            break;
+        default:
+            ReserveCascade<8>(max_sections);
+            break;
         }
-        else {
-            center_[stack_filter_counter_] = center;
-            radius_[stack_filter_counter_] = radius;
-            bw_[stack_filter_counter_] = bw;
-            ++stack_filter_counter_;
+        convolution_.Reserve(max_impulse_length);
+    }
+
+    /**
+     * @brief what SetDesign packs with
+     */
+    const AllPassBank::Options& GetOptions() const {
+        return options_;
+    }
+
+    const std::shared_ptr<const AllPassBank>& GetBank() const {
+        return bank_;
+    }
+
+    float GetGroupDelay(float w) const {
+        return bank_ != nullptr ? bank_->GetGroupDelay(w) : bulk_delay_.GetDelay();
+    }
+
+    /**
+     * @brief calls f(a, b) with the coefficients of every designed filter in process order
+     */
+    template<class Func>
+    void ForEachSection(Func&& f) const {
+        if (bank_ != nullptr) {
+            bank_->ForEachSection(std::forward<Func>(f));
         }
     }
 
-    inline void EndAddFilter() {
-        constexpr auto pi = std::numbers::pi_v<float>;
-        if (stack_filter_counter_ > 0) {
-            // 复制最后一个滤波器
-            auto center = center_[stack_filter_counter_ - 1];
-            auto radius = radius_[stack_filter_counter_ - 1];
-            auto bw = bw_[stack_filter_counter_ - 1];
-            for (; stack_filter_counter_ < Filter::kNumStack; ++stack_filter_counter_) {
-                center_[stack_filter_counter_] = center;
-                radius_[stack_filter_counter_] = radius;
-                bw_[stack_filter_counter_] = bw;
-            }
-            AddFilter(center, radius, bw);
+    size_t GetNumFilters() const {
+        return bank_ != nullptr ? bank_->GetNumFilters() : 0;
+    }
+private:
+    template<size_t N>
+    struct Cascade {
+        typename Filter<N>::template Arena<typename Filter<N>::State> states;
+        typename Filter<N>::BlockProcessFn process;
+    };
+
+    template<size_t N>
+    Cascade<N>& GetCascade() {
+        auto* cascade = std::get_if<Cascade<N>>(&cascade_);
+        if (cascade == nullptr || cascade->process == nullptr) {
+            cascade = &cascade_.emplace<Cascade<N>>();
+            cascade->process = Filter<N>::SelectBlockProcess(schedule_);
         }
+        return *cascade;
     }
 
-    inline void ClearFilters() {
-        stack_filter_counter_ = 0;
-        add_filter_counter_ = 0;
+    template<size_t N>
+    void ResizeCascade() {
+        GetCascade<N>().states.resize(bank_->GetFilters<N>().size());
     }
 
-    std::vector<Filter> filters_;
-    size_t stack_filter_counter_{};
-    size_t add_filter_counter_{};
-    float center_[Filter::kNumStack]{};
-    float radius_[Filter::kNumStack]{};
-    float bw_[Filter::kNumStack]{};
+    template<size_t N>
+    void ReserveCascade(size_t max_sections) {
+        GetCascade<N>().states.reserve((max_sections + N - 1) / N);
+    }
+
+    AllPassBank::Options options_;
+    Schedule schedule_{ Schedule::kWavefront };
+    int tile_size_{ kDefaultTileSize };
+
+    std::shared_ptr<const AllPassBank> bank_;
+    std::variant<Cascade<8>, Cascade<4>, Cascade<16>, Cascade<32>> cascade_;
 
-    float sample_rate_{48000.0f};
-    float beta_{ 0.5f }; // 最大群延迟的分数延迟
-    float magic_beta_{};
-    float min_bw_{};
+    BulkDelay bulk_delay_;
+    PartitionedConvolution convolution_;
 };
\ No newline at end of file
@@ -0,0 +1,26 @@
+#pragma once
+#include <xsimd/xsimd.hpp>
+
+/*
+* isa the kernels are compiled for, best first.
+* every arch here needs a <name>_<isa>.cpp instantiation and the matching flags in src/CMakeLists.txt
+*/
+using SimdArchList = xsimd::arch_list<xsimd::avx512f, xsimd::avx2, xsimd::sse2>;
+
+/**
+ * @brief name of the arch xsimd::dispatch will pick on this cpu
+ */
+inline static const char* GetSimdArchName() {
+    return xsimd::dispatch<SimdArchList>([]<class Arch>(Arch) {
+        return Arch::name();
+    })();
+}
+
+/**
+ * @brief float lanes of the widest register on this cpu
+ */
+inline static size_t GetSimdWidth() {
+    return xsimd::dispatch<SimdArchList>([]<class Arch>(Arch) {
+        return Arch::alignment() / sizeof(float);
+    })();
+}
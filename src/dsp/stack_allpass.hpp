@@ -1,120 +1,172 @@
 #pragma once
 #include <cmath>
 #include <ranges>
+#include <vector>
+#include <algorithm>
 #include <xsimd/xsimd.hpp>
+#include "simd_arch.hpp"
+
+#define ALIGNED64 alignas(64)
+
+/**
+ * @brief alignment of a stack of n floats, a whole stack is one to four simd loads so it
+ *        never needs more than its own size and stacks can sit back to back in an arena
+ */
+constexpr size_t StackAlignment(size_t n) {
+    return n * sizeof(float) < 64 ? n * sizeof(float) : 64;
+}
+
+enum class StackSchedule {
+    // sample by sample, every filter waits for the one before it
+    kSerial,
+    // filter i works on sample n - i, so the whole stack steps at once
+    kWavefront
+};
 
-#define ALIGNED32  __declspec(align(32))
+/**
+ * @brief phase of one section with its poles at radius * e^(+-j theta)
+ */
+inline float AllPassSectionPhase(float w, float theta, float radius) {
+    return -2 * w
+        - 2 * std::atan(radius * std::sin(w - theta) / (1 - radius * std::cos(w - theta)))
+        - 2 * std::atan(radius * std::sin(w + theta) / (1 - radius * std::cos(w + theta)));
+}
+
+/**
+ * @brief closed form, every pole adds (1 - r^2) / |1 - r e^(j(w - pole))|^2 samples.
+ *        the denominator is written with sin^2 of the half angle so it does not cancel near the pole,
+ *        GroupDelayGrid evaluates the same over a whole grid
+ */
+inline float AllPassSectionGroupDelay(float w, float theta, float radius) {
+    auto k = 1 - radius * radius;
+    auto a = (1 - radius) * (1 - radius);
+    auto lower = std::sin(0.5f * (w - theta));
+    auto upper = std::sin(0.5f * (w + theta));
+    return k / (a + 4 * radius * lower * lower) + k / (a + 4 * radius * upper * upper);
+}
 
 /*
 * ѵNȫͨļ˲
+* only the coefficients the kernels stream live here. the running state is a separate
+* State so one designed stack can be run by any number of channels, the design data
+* (theta, radius, bw) stays with whoever designed it.
+* both are dense, in a 64 byte aligned vector consecutive stacks form one arena
 */
+template<size_t N>
 class StackAllPassFilter {
 public:
-    static constexpr auto kNumStack = 8;
+    static constexpr auto kNumStack = N;
+    static constexpr auto kAlignment = StackAlignment(N);
 
-    StackAllPassFilter() = default;
-    StackAllPassFilter(float theta[kNumStack], float radius[kNumStack], float bw[kNumStack]) {
-        Set(theta, radius, bw);
-    }
+    using Schedule = StackSchedule;
 
-    void Process(float* input, int num_samples) {
-        using batch = xsimd::batch<float, xsimd::avx2>;
-
-        auto x2 = batch::load_aligned(&x2_[0]);
-        auto x1 = batch::load_aligned(&x1_[0]);
-        auto y2 = batch::load_aligned(&y2_[0]);
-        auto y1 = batch::load_aligned(&y1_[0]);
-        auto ca = batch::load_aligned(&a_[0]);
-        auto cb = batch::load_aligned(&b_[0]);
-        ALIGNED32 float tmp[kNumStack]{};
-        ALIGNED32 float x_tmp[kNumStack]{};
-        ALIGNED32 float y_tmp[kNumStack]{};
-
-        for (int n = 0; n < num_samples; ++n) {
-            auto tv = x2 + x1 * ca - y1 * ca - y2 * cb;
-            tv.store_aligned(&tmp[0]);
-            float t2 = input[n];
-            for (int i = 0; i < kNumStack; ++i) {
-                x_tmp[i] = t2;
-                auto filter_i_output = tmp[i] + t2 * b_[i];
-                y_tmp[i] = filter_i_output;
-                t2 = filter_i_output;
-            }
-            // output
-            input[n] = t2;
-
-            // write and swap register
-            y2 = y1;
-            y1 = batch::load_aligned(&y_tmp[0]);
-            x2 = x1;
-            x1 = batch::load_aligned(&x_tmp[0]);
-        }
+    template<class T>
+    using Arena = std::vector<T, xsimd::aligned_allocator<T, 64>>;
 
-        // store
-        y2.store_aligned(&y2_[0]);
-        y1.store_aligned(&y1_[0]);
-        x2.store_aligned(&x2_[0]);
-        x1.store_aligned(&x1_[0]);
-    }
+    struct State {
+        alignas(kAlignment) float x2[kNumStack]{};
+        alignas(kAlignment) float x1[kNumStack]{};
+        alignas(kAlignment) float y2[kNumStack]{};
+        alignas(kAlignment) float y1[kNumStack]{};
 
-    void Set(float theta[kNumStack], float radius[kNumStack], float bw[kNumStack]) {
-        // calc coeff
-        for (int i = 0; i < kNumStack; ++i) {
-            b_[i] = radius[i] * radius[i];
-            a_[i] = -2 * radius[i] * std::cos(theta[i]);
+        void PaincFb() {
+            std::fill(x2, x2 + kNumStack, 0.0f);
+            std::fill(x1, x1 + kNumStack, 0.0f);
+            std::fill(y2, y2 + kNumStack, 0.0f);
+            std::fill(y1, y1 + kNumStack, 0.0f);
         }
 
-        // copy additional info
-        std::ranges::copy(theta, theta + kNumStack, theta_);
-        std::ranges::copy(radius, radius + kNumStack, radius_);
-        std::ranges::copy(bw, bw + kNumStack, bw_);
-    }
+        /**
+         * @brief state of filter i from filter j of another stack
+         */
+        void CopyState(size_t i, const State& other, size_t j) {
+            x2[i] = other.x2[j];
+            x1[i] = other.x1[j];
+            y2[i] = other.y2[j];
+            y1[i] = other.y1[j];
+        }
+    };
+
+    // processes filters[0..num_filters) in order over the block, states[i] belongs to filters[i]
+    using BlockProcessFn = void(*)(const StackAllPassFilter* filters, State* states, size_t num_filters, float* input, int num_samples);
 
-    float GetBw(size_t i) const {
-        return bw_[i];
+    StackAllPassFilter() = default;
+    StackAllPassFilter(const float theta[kNumStack], const float radius[kNumStack]) {
+        Set(theta, radius);
     }
 
-    float GetTheta(size_t i) const {
-        return theta_[i];
+    /**
+     * @brief kernels are compiled once per ISA in stack_allpass_<isa>.cpp
+     *        see stack_allpass_kernel.hpp
+     */
+    template<class Arch>
+    void Process(State& state, float* input, int num_samples) const;
+
+    /**
+     * @brief same result and state as Process. the skew is filled and drained inside the block
+     */
+    template<class Arch>
+    void ProcessWavefront(State& state, float* input, int num_samples) const {
+        ProcessWavefrontFused<Arch, 1>(this, &state, input, num_samples);
     }
 
-    float GetGroupDelay(float w) const {
-        constexpr auto interval = 1.0f / 10000.0f;
-        return -(GetPhaseResponse(w + interval) - GetPhaseResponse(w)) / interval;
+    /**
+     * @brief wavefront over kFuse consecutive stacks as one pipeline, the samples between
+     *        them are passed in registers and never touch the buffer
+     */
+    template<class Arch, size_t kFuse>
+    static void ProcessWavefrontFused(const StackAllPassFilter* stacks, State* states, float* input, int num_samples);
+
+    template<class Arch>
+    static void ProcessBlock(const StackAllPassFilter* filters, State* states, size_t num_filters, float* input, int num_samples);
+
+    template<class Arch>
+    static void ProcessBlockWavefront(const StackAllPassFilter* filters, State* states, size_t num_filters, float* input, int num_samples);
+
+    /**
+     * @brief pick the best kernel the running cpu supports
+     */
+    static BlockProcessFn SelectBlockProcess(Schedule schedule) {
+        return xsimd::dispatch<SimdArchList>([schedule]<class Arch>(Arch) -> BlockProcessFn {
+            if (schedule == Schedule::kWavefront) {
+                return &StackAllPassFilter::ProcessBlockWavefront<Arch>;
+            }
+            return &StackAllPassFilter::ProcessBlock<Arch>;
+        })();
     }
 
-    float GetPhaseResponse(float w) const {
-        float ret = 0.0f;
-        for (int i = 0; i < kNumStack; ++i) {
-            ret += GetSinglePhaseResponse(w, theta_[i], radius_[i]);
+    void Set(const float theta[kNumStack], const float radius[kNumStack]) {
+        // calc coeff
+        for (size_t i = 0; i < kNumStack; ++i) {
+            b_[i] = radius[i] * radius[i];
+            a_[i] = -2 * radius[i] * std::cos(theta[i]);
         }
-        return ret;
     }
 
-    void PaincFb() {
-        std::fill(x2_, x2_ + kNumStack, 0.0f);
-        std::fill(x1_, x1_ + kNumStack, 0.0f);
-        std::fill(y2_, y2_ + kNumStack, 0.0f);
-        std::fill(y1_, y1_ + kNumStack, 0.0f);
-    }
-private:
-    inline static float GetSinglePhaseResponse(float w, float theta, float radius) {
-        return -2 * w
-            - 2 * std::atan(radius * std::sin(w - theta) / (1 - radius * std::cos(w - theta)))
-            - std::atan(radius * std::sin(w + theta) / (1 - radius * std::cos(w + theta)));
+    float GetCoeffA(size_t i) const {
+        return a_[i];
     }
 
-    float theta_[kNumStack]{};
-    float radius_[kNumStack]{};
-    float bw_[kNumStack]{};
-
+    float GetCoeffB(size_t i) const {
+        return b_[i];
+    }
+private:
     // coeff
-    ALIGNED32 float a_[kNumStack]{};
-    ALIGNED32 float b_[kNumStack]{};
-
-    // data
-    ALIGNED32 float x2_[kNumStack]{};
-    ALIGNED32 float x1_[kNumStack]{};
-    ALIGNED32 float y2_[kNumStack]{};
-    ALIGNED32 float y1_[kNumStack]{};
+    alignas(kAlignment) float a_[kNumStack]{};
+    alignas(kAlignment) float b_[kNumStack]{};
 };
+
+// one stack per register on sse2/avx2/avx512, 32 is two avx512 registers
+#define STACK_ALLPASS_INSTANTIATE_N(prefix, arch, n) \
+    prefix template void StackAllPassFilter<n>::ProcessBlock<arch>(const StackAllPassFilter<n>*, StackAllPassFilter<n>::State*, size_t, float*, int); \
+    prefix template void StackAllPassFilter<n>::ProcessBlockWavefront<arch>(const StackAllPassFilter<n>*, StackAllPassFilter<n>::State*, size_t, float*, int);
+
+#define STACK_ALLPASS_INSTANTIATE(prefix, arch) \
+    STACK_ALLPASS_INSTANTIATE_N(prefix, arch, 4) \
+    STACK_ALLPASS_INSTANTIATE_N(prefix, arch, 8) \
+    STACK_ALLPASS_INSTANTIATE_N(prefix, arch, 16) \
+    STACK_ALLPASS_INSTANTIATE_N(prefix, arch, 32)
+
+STACK_ALLPASS_INSTANTIATE(extern, xsimd::sse2)
+STACK_ALLPASS_INSTANTIATE(extern, xsimd::avx2)
+STACK_ALLPASS_INSTANTIATE(extern, xsimd::avx512f)
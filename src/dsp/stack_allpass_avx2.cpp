@@ -0,0 +1,3 @@
+#include "stack_allpass_kernel.hpp"
+
+STACK_ALLPASS_INSTANTIATE(, xsimd::avx2)
\ No newline at end of file
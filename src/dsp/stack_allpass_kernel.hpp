@@ -0,0 +1,223 @@
+#pragma once
+#include "stack_allpass.hpp"
+
+/*
+* only include this in the stack_allpass_<isa>.cpp files.
+* everything here is compiled with that isa enabled, so do not call non-template inline
+* functions from these kernels, the linker may keep the avx copy for everyone.
+*/
+
+namespace stack_allpass_detail {
+// the widest batch that is not wider than the stack
+template<class Arch, size_t N>
+struct StackBatch {
+    using type = xsimd::batch<float, Arch>;
+};
+
+template<size_t N>
+    requires (N < 16)
+struct StackBatch<xsimd::avx512f, N> {
+    using type = typename StackBatch<xsimd::avx2, N>::type;
+};
+
+template<size_t N>
+    requires (N < 8)
+struct StackBatch<xsimd::avx2, N> {
+    using type = xsimd::batch<float, xsimd::sse2>;
+};
+
+/*
+* how many stacks one fused wavefront keeps in registers. every batch of the pipeline holds
+* 7 live registers, so 16 register isa fit 2 batches and avx512 fits 4. the pipeline is
+* capped at 32 filters because its skew is filled and drained in every tile
+*/
+template<class Arch, size_t N>
+constexpr size_t NumFusedStack() {
+    constexpr size_t kMaxFusedFilters = 32;
+    constexpr size_t kNumRegisterBatch = std::is_base_of_v<xsimd::avx512f, Arch> ? 4 : 2;
+    constexpr size_t kStackBatch = N / StackBatch<Arch, N>::type::size;
+    size_t fuse = kNumRegisterBatch / kStackBatch;
+    fuse = fuse * N > kMaxFusedFilters ? kMaxFusedFilters / N : fuse;
+    return fuse < 1 ? 1 : fuse;
+}
+}
+
+template<size_t N>
+template<class Arch>
+void StackAllPassFilter<N>::Process(State& state, float* input, int num_samples) const {
+    using batch = typename stack_allpass_detail::StackBatch<Arch, kNumStack>::type;
+    constexpr auto kBatchSize = batch::size;
+    constexpr auto kNumBatch = kNumStack / kBatchSize;
+    static_assert(kNumStack % kBatchSize == 0);
+
+    batch x2[kNumBatch];
+    batch x1[kNumBatch];
+    batch y2[kNumBatch];
+    batch y1[kNumBatch];
+    batch ca[kNumBatch];
+    batch cb[kNumBatch];
+    for (size_t k = 0; k < kNumBatch; ++k) {
+        x2[k] = batch::load_aligned(&state.x2[k * kBatchSize]);
+        x1[k] = batch::load_aligned(&state.x1[k * kBatchSize]);
+        y2[k] = batch::load_aligned(&state.y2[k * kBatchSize]);
+        y1[k] = batch::load_aligned(&state.y1[k * kBatchSize]);
+        ca[k] = batch::load_aligned(&a_[k * kBatchSize]);
+        cb[k] = batch::load_aligned(&b_[k * kBatchSize]);
+    }
+    ALIGNED64 float tmp[kNumStack]{};
+    ALIGNED64 float x_tmp[kNumStack]{};
+    ALIGNED64 float y_tmp[kNumStack]{};
+
+    for (int n = 0; n < num_samples; ++n) {
+        for (size_t k = 0; k < kNumBatch; ++k) {
+            auto tv = x2[k] + x1[k] * ca[k] - y1[k] * ca[k] - y2[k] * cb[k];
+            tv.store_aligned(&tmp[k * kBatchSize]);
+        }
+        float t2 = input[n];
+        for (size_t i = 0; i < kNumStack; ++i) {
+            x_tmp[i] = t2;
+            auto filter_i_output = tmp[i] + t2 * b_[i];
+            y_tmp[i] = filter_i_output;
+            t2 = filter_i_output;
+        }
+        // output
+        input[n] = t2;
+
+        // write and swap register
+        for (size_t k = 0; k < kNumBatch; ++k) {
+            y2[k] = y1[k];
+            y1[k] = batch::load_aligned(&y_tmp[k * kBatchSize]);
+            x2[k] = x1[k];
+            x1[k] = batch::load_aligned(&x_tmp[k * kBatchSize]);
+        }
+    }
+
+    // store
+    for (size_t k = 0; k < kNumBatch; ++k) {
+        y2[k].store_aligned(&state.y2[k * kBatchSize]);
+        y1[k].store_aligned(&state.y1[k * kBatchSize]);
+        x2[k].store_aligned(&state.x2[k * kBatchSize]);
+        x1[k].store_aligned(&state.x1[k * kBatchSize]);
+    }
+}
+
+template<size_t N>
+template<class Arch, size_t kFuse>
+void StackAllPassFilter<N>::ProcessWavefrontFused(const StackAllPassFilter* stacks, State* states, float* input, int num_samples) {
+    using batch = typename stack_allpass_detail::StackBatch<Arch, kNumStack>::type;
+    constexpr auto kBatchSize = batch::size;
+    constexpr auto kStackBatch = kNumStack / kBatchSize;
+    constexpr auto kNumBatch = kStackBatch * kFuse;
+    constexpr auto kLastLane = kBatchSize - 1;
+    constexpr auto kSkew = static_cast<int>(kNumStack * kFuse) - 1;
+    static_assert(kNumStack % kBatchSize == 0);
+
+    ALIGNED64 float section_index[kNumStack * kFuse]{};
+    for (size_t i = 0; i < kNumStack * kFuse; ++i) {
+        section_index[i] = static_cast<float>(i);
+    }
+
+    // batch k of the pipeline is batch k % kStackBatch of stack k / kStackBatch
+    batch x2[kNumBatch];
+    batch x1[kNumBatch];
+    batch y2[kNumBatch];
+    batch y1[kNumBatch];
+    batch ca[kNumBatch];
+    batch cb[kNumBatch];
+    batch section[kNumBatch];
+    for (size_t k = 0; k < kNumBatch; ++k) {
+        const auto& stack = stacks[k / kStackBatch];
+        const auto& state = states[k / kStackBatch];
+        auto offset = (k % kStackBatch) * kBatchSize;
+        x2[k] = batch::load_aligned(&state.x2[offset]);
+        x1[k] = batch::load_aligned(&state.x1[offset]);
+        y2[k] = batch::load_aligned(&state.y2[offset]);
+        y1[k] = batch::load_aligned(&state.y1[offset]);
+        ca[k] = batch::load_aligned(&stack.a_[offset]);
+        cb[k] = batch::load_aligned(&stack.b_[offset]);
+        section[k] = batch::load_aligned(&section_index[k * kBatchSize]);
+    }
+    const auto first_lane = section[0] < batch(0.5f);
+    ALIGNED64 float last[kBatchSize]{};
+
+    // at step t filter i runs sample t - i, its input is what filter i - 1 produced one step before
+    auto step = [&]<bool kMasked>(int t) {
+        batch x[kNumBatch];
+        auto in = kMasked && t >= num_samples ? 0.0f : input[t];
+        x[0] = xsimd::select(first_lane, batch(in), xsimd::slide_left<sizeof(float)>(y1[0]));
+        for (size_t k = 1; k < kNumBatch; ++k) {
+            x[k] = xsimd::slide_left<sizeof(float)>(y1[k])
+                + xsimd::slide_right<sizeof(float) * kLastLane>(y1[k - 1]);
+        }
+
+        for (size_t k = 0; k < kNumBatch; ++k) {
+            auto y = x2[k] + x1[k] * ca[k] - y1[k] * ca[k] - y2[k] * cb[k] + x[k] * cb[k];
+            if constexpr (kMasked) {
+                // filling or draining the skew, filters outside the block keep their state
+                auto n = batch(static_cast<float>(t)) - section[k];
+                auto active = (n >= batch(0.0f)) & (n < batch(static_cast<float>(num_samples)));
+                x2[k] = xsimd::select(active, x1[k], x2[k]);
+                x1[k] = xsimd::select(active, x[k], x1[k]);
+                y2[k] = xsimd::select(active, y1[k], y2[k]);
+                y1[k] = xsimd::select(active, y, y1[k]);
+            }
+            else {
+                x2[k] = x1[k];
+                x1[k] = x[k];
+                y2[k] = y1[k];
+                y1[k] = y;
+            }
+        }
+
+        // output of the last filter, input[t - kSkew] was already consumed
+        if (t >= kSkew) {
+            y1[kNumBatch - 1].store_aligned(last);
+            input[t - kSkew] = last[kLastLane];
+        }
+    };
+
+    const int num_steps = num_samples + kSkew;
+    const int fill_end = kSkew < num_steps ? kSkew : num_steps;
+    const int drain_begin = kSkew > num_samples ? kSkew : num_samples;
+    for (int t = 0; t < fill_end; ++t) {
+        step.template operator()<true>(t);
+    }
+    for (int t = kSkew; t < num_samples; ++t) {
+        step.template operator()<false>(t);
+    }
+    for (int t = drain_begin; t < num_steps; ++t) {
+        step.template operator()<true>(t);
+    }
+
+    // store
+    for (size_t k = 0; k < kNumBatch; ++k) {
+        auto& state = states[k / kStackBatch];
+        auto offset = (k % kStackBatch) * kBatchSize;
+        y2[k].store_aligned(&state.y2[offset]);
+        y1[k].store_aligned(&state.y1[offset]);
+        x2[k].store_aligned(&state.x2[offset]);
+        x1[k].store_aligned(&state.x1[offset]);
+    }
+}
+
+template<size_t N>
+template<class Arch>
+void StackAllPassFilter<N>::ProcessBlock(const StackAllPassFilter* filters, State* states, size_t num_filters, float* input, int num_samples) {
+    for (size_t i = 0; i < num_filters; ++i) {
+        filters[i].template Process<Arch>(states[i], input, num_samples);
+    }
+}
+
+
+template<size_t N>
+template<class Arch>
+void StackAllPassFilter<N>::ProcessBlockWavefront(const StackAllPassFilter* filters, State* states, size_t num_filters, float* input, int num_samples) {
+    constexpr auto kFuse = stack_allpass_detail::NumFusedStack<Arch, N>();
+    size_t i = 0;
+    for (; i + kFuse <= num_filters; i += kFuse) {
+        ProcessWavefrontFused<Arch, kFuse>(filters + i, states + i, input, num_samples);
+    }
+    for (; i < num_filters; ++i) {
+        filters[i].template ProcessWavefront<Arch>(states[i], input, num_samples);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <thread>
+
+/*
+* lock free handoff of three preallocated slots between one writer and one reader.
+* the writer fills its slot and publishes it, the reader takes the newest published slot
+* whenever it wants to. the reader never waits, the writer only waits while the reader is
+* still moving state out of the slot it just gave back
+*/
+class TripleBufferIndex {
+public:
+    static constexpr int kNumSlots = 3;
+
+    /**
+     * @brief not thread safe, only while neither side is running
+     */
+    void Reset() {
+        write_ = 0;
+        middle_.store(1);
+        read_ = 2;
+        reader_busy_.store(false);
+    }
+
+    // writer side
+    int GetWriteIndex() const {
+        return write_;
+    }
+
+    /**
+     * @brief hands the write slot to the reader and takes back a free one
+     */
+    void Publish() {
+        write_ = middle_.exchange(write_ | kFresh) & kIndexMask;
+        while (reader_busy_.load()) {
+            std::this_thread::yield();
+        }
+    }
+
+    // reader side
+    int GetReadIndex() const {
+        return read_;
+    }
+
+    /**
+     * @brief switches to the newest published slot
+     * @return the slot given back, -1 if nothing new was published. EndAcquire must follow
+     */
+    int BeginAcquire() {
+        if ((middle_.load(std::memory_order_relaxed) & kFresh) == 0) {
+            return -1;
+        }
+
+        reader_busy_.store(true);
+        auto old = read_;
+        read_ = middle_.exchange(old) & kIndexMask;
+        return old;
+    }
+
+    /**
+     * @brief the slot given back by BeginAcquire can be reused by the writer from now on
+     */
+    void EndAcquire() {
+        reader_busy_.store(false);
+    }
+private:
+    static constexpr int kIndexMask = 3;
+    static constexpr int kFresh = 4;
+
+    int write_{ 0 };
+    std::atomic<int> middle_{ 1 };
+    int read_{ 2 };
+    std::atomic<bool> reader_busy_{ false };
+};
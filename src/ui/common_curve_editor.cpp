@@ -5,91 +5,9 @@ static constexpr auto height = width;
 static constexpr auto kMaxOfDistance = 200;
 static constexpr auto kCompCircleSize = 5.0f;
 
-namespace mana::detail {
-CurveXYPointComponent::CurveXYPointComponent(int idx)
-    : idx_(idx) {
-    setSize(width, height);
-}
-
-void CurveXYPointComponent::paint(juce::Graphics& g) {
-    if (isMouseOver()) {
-        g.setColour(juce::Colours::white);
-        g.drawEllipse(getLocalBounds().toFloat(), 1.0f);
-    }
-    g.setColour(juce::Colours::white);
-    g.fillEllipse(juce::Rectangle{ 0.0f,0.0f,kCompCircleSize,kCompCircleSize }.withCentre(getLocalBounds().getCentre().toFloat()));
-}
-
-void CurveXYPointComponent::mouseDown(const juce::MouseEvent& e) {
-    if (!e.mods.isRightButtonDown())
-        return;
-
-    auto* parent = static_cast<CommonCurveEditor*>(getParentComponent());
-    if (parent->IsLastXyPoint(idx_))
-        return;
-
-    auto* curve = parent->curve_;
-    using pe = CurveV2::PowerEnum;
-    auto set_type = [idx = idx_, curve](pe type) {
-        return [i = idx, curve, t = type]() {
-            curve->SetPowerType(i, t);
-        };
-    };
-
-    // will it dangling pointer/ref?
-    popup_menu_ = std::make_unique<juce::PopupMenu>();
-    auto curr_power_type = parent->curve_->GetPoint(idx_).power_type;
-    popup_menu_->addItem("keep", true, curr_power_type == pe::kKeep, set_type(pe::kKeep));
-    popup_menu_->addItem("exp", true, curr_power_type == pe::kExp, set_type(pe::kExp));
-    popup_menu_->addItem("wave_sine", true, curr_power_type == pe::kWaveSine, set_type(pe::kWaveSine));
-    popup_menu_->addItem("wave_tri", true, curr_power_type == pe::kWaveTri, set_type(pe::kWaveTri));
-    popup_menu_->addItem("wave_square", true, curr_power_type == pe::kWaveSquare, set_type(pe::kWaveSquare));
-    popup_menu_->addSeparator();
-    popup_menu_->addItem("delete", [idx = idx_, curve] {curve->Remove(idx); });
-    popup_menu_->showMenuAsync(juce::PopupMenu::Options{});
-}
-
-void CurveXYPointComponent::mouseDrag(const juce::MouseEvent& e) {
-    static_cast<CommonCurveEditor*>(getParentComponent())->DragXyPoint(*this, e);
-}
-
-void CurveXYPointComponent::mouseDoubleClick(const juce::MouseEvent& e) {
-    static_cast<CommonCurveEditor*>(getParentComponent())->RemoveXyPoint(*this);
-}
-
-CurvePowerPointComponent::CurvePowerPointComponent(int idx)
-    : idx_(idx) {
-    setSize(width, height);
-}
-
-void CurvePowerPointComponent::paint(juce::Graphics& g) {
-    if (isMouseOver()) {
-        g.setColour(juce::Colours::white);
-        g.drawEllipse(getLocalBounds().toFloat(), 1.0f);
-    }
-    g.setColour(juce::Colours::white);
-    g.drawEllipse(juce::Rectangle{ 0.0f,0.0f,kCompCircleSize,kCompCircleSize }.withCentre(getLocalBounds().getCentre().toFloat()), 1.0f);
-}
-
-void CurvePowerPointComponent::mouseDown(const juce::MouseEvent& e) {
-    auto* parent = static_cast<CommonCurveEditor*>(getParentComponent());
-    last_power_ = parent->curve_->GetPoint(idx_).power;
-}
-
-void CurvePowerPointComponent::mouseDrag(const juce::MouseEvent& e) {
-    auto* parent = static_cast<CommonCurveEditor*>(getParentComponent());
-    auto nor_y = static_cast<float>(e.getDistanceFromDragStartY()) / static_cast<float>(kMaxOfDistance);
-    parent->curve_->SetPower(idx_, last_power_ + nor_y);
-}
-
-void CurvePowerPointComponent::mouseDoubleClick(const juce::MouseEvent& e) {
-    // reset power to 0
-    static_cast<CommonCurveEditor*>(getParentComponent())->curve_->SetPower(idx_, 0.0f);
-}
-}
-
 namespace mana {
 CommonCurveEditor::~CommonCurveEditor() {
+    EndDragEdit();
     if (curve_ != nullptr)
         curve_->RemoveListener(this);
 }
@@ -152,15 +70,44 @@ void CommonCurveEditor::paint(juce::Graphics& g) {
 
     g.setColour(bg_color.darker());
     g.drawRect(GetComponentBounds().expanded(2.0f, 2.0f), 2.0f);
+
+    if (curve_ != nullptr)
+        PaintPoints(g);
 }
 
-void CommonCurveEditor::resized() {
-    for (const auto& xy : xy_points_) {
-        SetXyPointPos(*xy);
+void CommonCurveEditor::PaintPoints(juce::Graphics& g) const {
+    auto clip = g.getClipBounds().toFloat().expanded(width / 2.0f, height / 2.0f);
+    auto circle = juce::Rectangle{ 0.0f,0.0f,kCompCircleSize,kCompCircleSize };
+    auto hover = juce::Rectangle{ 0.0f,0.0f,static_cast<float>(width),static_cast<float>(height) };
+    const auto num_points = curve_->GetNumPoints();
+
+    g.setColour(juce::Colours::white);
+    // thousands of points share a few hundred pixels, a pixel is drawn once
+    auto last_drawn = juce::Point{ -1, -1 };
+    for (int i = 0; i < num_points; ++i) {
+        auto pos = GetXyPointPos(i);
+        if (!clip.contains(pos) || pos.roundToInt() == last_drawn)
+            continue;
+
+        last_drawn = pos.roundToInt();
+        g.fillEllipse(circle.withCentre(pos));
     }
-    for (const auto& power : power_points_) {
-        SetPowerPointPos(*power);
+
+    for (int i = 0; i + 1 < num_points; ++i) {
+        if (!HasPowerPoint(i))
+            continue;
+
+        auto pos = GetPowerPointPos(i);
+        if (!clip.contains(pos))
+            continue;
+
+        g.drawEllipse(circle.withCentre(pos), 1.0f);
     }
+
+    if (hover_.type == HitType::kXy)
+        g.drawEllipse(hover.withCentre(GetXyPointPos(hover_.idx)), 1.0f);
+    else if (hover_.type == HitType::kPower)
+        g.drawEllipse(hover.withCentre(GetPowerPointPos(hover_.idx)), 1.0f);
 }
 
 void CommonCurveEditor::SetCurve(CurveV2* new_curve) {
@@ -169,6 +116,7 @@ void CommonCurveEditor::SetCurve(CurveV2* new_curve) {
     if (new_curve == curve_)
         return;
 
+    EndDragEdit();
     if (curve_ != nullptr)
         curve_->RemoveListener(this);
 
@@ -177,10 +125,148 @@ void CommonCurveEditor::SetCurve(CurveV2* new_curve) {
     OnReload(curve_);
 }
 
+CommonCurveEditor::Hit CommonCurveEditor::HitTest(juce::Point<float> pos) const {
+    if (curve_ == nullptr)
+        return {};
+
+    // only the points within half a handle in x can be hit, they are found by x in O(log points)
+    const auto half_width = width / 2.0f;
+    const auto half_height = height / 2.0f;
+    auto bound = GetComponentBounds().toFloat();
+    auto first = curve_->LowerBound((pos.x - half_width - bound.getX()) / bound.getWidth());
+    auto last = curve_->LowerBound((pos.x + half_width - bound.getX()) / bound.getWidth());
+
+    Hit hit;
+    auto nearest = std::numeric_limits<float>::max();
+    auto test = [&](Hit candidate, juce::Point<float> center) {
+        auto distance = pos.getDistanceSquaredFrom(center);
+        if (std::abs(center.x - pos.x) <= half_width
+            && std::abs(center.y - pos.y) <= half_height
+            && distance < nearest) {
+            nearest = distance;
+            hit = candidate;
+        }
+    };
+    for (int i = first; i < last; ++i) {
+        test(Hit{ HitType::kXy, i }, GetXyPointPos(i));
+    }
+    // a handle lies between its two points, the one left of the first point can be in range too
+    for (int i = std::max(0, first - 1); i < std::min(last, curve_->GetNumPoints() - 1); ++i) {
+        if (HasPowerPoint(i))
+            test(Hit{ HitType::kPower, i }, GetPowerPointPos(i));
+    }
+    return hit;
+}
+
+void CommonCurveEditor::SetHover(Hit hover) {
+    if (hover == hover_)
+        return;
+
+    hover_ = hover;
+    repaint();
+}
+
+juce::Point<float> CommonCurveEditor::GetXyPointPos(int idx) const {
+    auto point = curve_->GetPoint(idx);
+    auto bound = GetComponentBounds().toFloat();
+    return {
+        bound.getWidth() * point.x + bound.getX(),
+        bound.getHeight() * (1.0f - point.y) + bound.getY()
+    };
+}
+
+juce::Point<float> CommonCurveEditor::GetPowerPointPos(int idx) const {
+    auto bound = GetComponentBounds().toFloat();
+    auto x = std::midpoint(GetXyPointPos(idx).x, GetXyPointPos(idx + 1).x);
+    auto nor_x = (x - bound.getX()) / bound.getWidth();
+    auto y = std::lerp(bound.getBottom(), bound.getY(), curve_->GetNormalize(nor_x));
+    return { x, y };
+}
+
+bool CommonCurveEditor::HasPowerPoint(int idx) const {
+    auto before = GetXyPointPos(idx);
+    auto after = GetXyPointPos(idx + 1);
+    return after.x - before.x >= kCompCircleSize && std::abs(after.y - before.y) >= 1.0f;
+}
+
+void CommonCurveEditor::mouseMove(const juce::MouseEvent& e) {
+    SetHover(HitTest(e.position));
+}
+
+void CommonCurveEditor::mouseExit(const juce::MouseEvent& e) {
+    SetHover(Hit{});
+}
+
+void CommonCurveEditor::mouseDown(const juce::MouseEvent& e) {
+    if (curve_ == nullptr)
+        return;
+
+    auto hit = HitTest(e.position);
+    if (e.mods.isRightButtonDown()) {
+        if (hit.type == HitType::kXy && !IsLastXyPoint(hit.idx))
+            ShowPointMenu(hit.idx);
+        return;
+    }
+
+    drag_ = hit;
+    if (drag_.type == HitType::kPower)
+        last_power_ = curve_->GetPoint(drag_.idx).power;
+    if (drag_.type != HitType::kNone && !editing_) {
+        curve_->BeginEdit();
+        editing_ = true;
+    }
+}
+
+void CommonCurveEditor::mouseDrag(const juce::MouseEvent& e) {
+    if (curve_ == nullptr)
+        return;
+
+    switch (drag_.type) {
+    case HitType::kXy:
+        DragXyPoint(drag_.idx, e);
+        break;
+    case HitType::kPower:
+    {
+        auto nor_y = static_cast<float>(e.getDistanceFromDragStartY()) / static_cast<float>(kMaxOfDistance);
+        curve_->SetPower(drag_.idx, last_power_ + nor_y);
+        break;
+    }
+    default:
+        break;
+    }
+    if (editing_)
+        curve_->CommitEdit();
+}
+
+void CommonCurveEditor::mouseUp(const juce::MouseEvent& e) {
+    drag_ = Hit{};
+    EndDragEdit();
+}
+
+void CommonCurveEditor::EndDragEdit() {
+    if (!editing_)
+        return;
+
+    editing_ = false;
+    curve_->EndEdit();
+}
+
 void CommonCurveEditor::mouseDoubleClick(const juce::MouseEvent& e) {
     if (curve_ == nullptr)
         return;
 
+    auto hit = HitTest(e.position);
+    if (hit.type == HitType::kXy) {
+        if (!IsFirstXyPoint(hit.idx) && !IsLastXyPoint(hit.idx))
+            curve_->Remove(hit.idx);
+        return;
+    }
+    if (hit.type == HitType::kPower) {
+        // reset power to 0
+        curve_->SetPower(hit.idx, 0.0f);
+        return;
+    }
+
     // todo: solve upside down in pow power mode
     auto nor_x = (e.getMouseDownX() - GetComponentBounds().getX()) / static_cast<float>(GetComponentBounds().getWidth());
     auto nor_y = 1.0f - (e.getMouseDownY() - GetComponentBounds().getY()) / static_cast<float>(GetComponentBounds().getHeight());
@@ -189,12 +275,8 @@ void CommonCurveEditor::mouseDoubleClick(const juce::MouseEvent& e) {
     curve_->AddPoint(CurveV2::Point{ nor_x, nor_y });
 }
 
-void CommonCurveEditor::DragXyPoint(detail::CurveXYPointComponent& p, const juce::MouseEvent& e) {
-    if (curve_ == nullptr)
-        return;
-
-    auto ee = e.getEventRelativeTo(this);
-    auto point_pos = ee.getPosition().toFloat();
+void CommonCurveEditor::DragXyPoint(int idx, const juce::MouseEvent& e) {
+    auto point_pos = e.position;
     auto bound = GetComponentBounds().toFloat();
     auto nor_x = (point_pos.x - bound.getX()) / bound.getWidth();
     auto nor_y = 1.0f - (point_pos.y - bound.getY()) / bound.getHeight();
@@ -219,36 +301,29 @@ void CommonCurveEditor::DragXyPoint(detail::CurveXYPointComponent& p, const juce
             nor_y = ty / (y_grid_ - 1.0f);
         }
     }
-    curve_->SetXy(p.idx_, nor_x, nor_y);
-}
-
-void CommonCurveEditor::SetPowerPointPos(detail::CurvePowerPointComponent& p) {
-    auto before_center = xy_points_[p.idx_]->getBounds().getCentre().toFloat();
-    auto after_center = xy_points_[p.idx_ + 1]->getBounds().getCentre().toFloat();
-    auto bound = GetComponentBounds().toFloat();
-
-    p.setVisible(before_center.x != after_center.x && before_center.y != after_center.y);
-
-    auto x = std::midpoint(before_center.x, after_center.x);
-    auto nor_x = (x - bound.getX()) / bound.getWidth();
-    auto y = std::lerp(bound.getBottom(), bound.getY(), curve_->GetNormalize(nor_x));
-    //auto y = std::midpoint(before_center.y, after_center.y);
-    //p.setBounds(p.getBounds().withCentre(juce::Point{ x,y }));
-    p.setBounds(p.getBounds().withCentre(juce::Point{ x,y, }.roundToInt()));
-}
-
-void CommonCurveEditor::SetXyPointPos(detail::CurveXYPointComponent& p) {
-    auto point = curve_->GetPoint(p.idx_);
-    auto x = GetComponentBounds().getWidth() * point.x + GetComponentBounds().getX();
-    auto y = GetComponentBounds().getHeight() * (1.0f - point.y) + GetComponentBounds().getY();
-    p.setBounds(p.getBounds().toFloat().withCentre(juce::Point{ x,y }).toNearestInt());
+    curve_->SetXy(idx, nor_x, nor_y);
 }
 
-void CommonCurveEditor::RemoveXyPoint(detail::CurveXYPointComponent& p) {
-    if (IsFirstXyPoint(p.idx_) || IsLastXyPoint(p.idx_))
-        return;
+void CommonCurveEditor::ShowPointMenu(int idx) {
+    auto* curve = curve_;
+    using pe = CurveV2::PowerEnum;
+    auto set_type = [idx, curve](pe type) {
+        return [i = idx, curve, t = type]() {
+            curve->SetPowerType(i, t);
+        };
+    };
 
-    curve_->Remove(p.idx_);
+    // will it dangling pointer/ref?
+    popup_menu_ = std::make_unique<juce::PopupMenu>();
+    auto curr_power_type = curve_->GetPoint(idx).power_type;
+    popup_menu_->addItem("keep", true, curr_power_type == pe::kKeep, set_type(pe::kKeep));
+    popup_menu_->addItem("exp", true, curr_power_type == pe::kExp, set_type(pe::kExp));
+    popup_menu_->addItem("wave_sine", true, curr_power_type == pe::kWaveSine, set_type(pe::kWaveSine));
+    popup_menu_->addItem("wave_tri", true, curr_power_type == pe::kWaveTri, set_type(pe::kWaveTri));
+    popup_menu_->addItem("wave_square", true, curr_power_type == pe::kWaveSquare, set_type(pe::kWaveSquare));
+    popup_menu_->addSeparator();
+    popup_menu_->addItem("delete", [idx, curve] {curve->Remove(idx); });
+    popup_menu_->showMenuAsync(juce::PopupMenu::Options{});
 }
 
 juce::Rectangle<int> CommonCurveEditor::GetComponentBounds() const {
@@ -259,26 +334,10 @@ void CommonCurveEditor::OnAddPoint(CurveV2* generator, CurveV2::Point point, int
     if (curve_ != generator)
         return;
 
-    auto add_idx = before_idx + 1;
-    xy_points_.emplace(xy_points_.cbegin() + add_idx, std::make_unique<detail::CurveXYPointComponent>(add_idx));
-    power_points_.emplace(power_points_.cbegin() + add_idx, std::make_unique<detail::CurvePowerPointComponent>(add_idx));
-
-    for (int i = add_idx + 1; i < xy_points_.size(); ++i)
-        xy_points_[i]->idx_++;
-    for (int i = add_idx + 1; i < power_points_.size(); ++i)
-        power_points_[i]->idx_++;
-
-    const auto& add_xy = xy_points_[add_idx];
-    const auto& add_power = power_points_[add_idx];
-    const auto& before_power = power_points_[before_idx];
-
-    // todo: show new component and adjust addxy,before_power,add_power bounds
-    addAndMakeVisible(add_xy.get());
-    addAndMakeVisible(add_power.get());
-    SetXyPointPos(*add_xy);
-    //LimitXyPoint(*add_xy);
-    SetPowerPointPos(*add_power);
-    SetPowerPointPos(*before_power);
+    // the point behind before_idx and everything after it moved one up
+    if (drag_.type != HitType::kNone && drag_.idx > before_idx)
+        ++drag_.idx;
+    hover_ = Hit{};
     repaint();
 }
 
@@ -286,16 +345,12 @@ void CommonCurveEditor::OnRemovePoint(CurveV2* generator, int idx) {
     if (curve_ != generator)
         return;
 
-    xy_points_.erase(xy_points_.cbegin() + idx);
-    power_points_.erase(power_points_.cbegin() + idx);
-
-    for (int i = idx; i < xy_points_.size(); ++i)
-        xy_points_[i]->idx_--;
-    for (int i = idx; i < power_points_.size(); ++i)
-        power_points_[i]->idx_--;
-
-    // todo: adjust before_power bounds
-    SetPowerPointPos(*power_points_[idx - 1]);
+    // the segments before and after idx became one at idx - 1
+    if (drag_.type != HitType::kNone && drag_.idx == idx)
+        drag_ = Hit{};
+    else if (drag_.idx > idx)
+        --drag_.idx;
+    hover_ = Hit{};
     repaint();
 }
 
@@ -303,48 +358,16 @@ void CommonCurveEditor::OnReload(CurveV2* generator) {
     if (curve_ != generator)
         return;
 
-    // rebuild interface
-    power_points_.clear();
-    xy_points_.clear();
-
-    const auto& points = curve_->GetAllPoints();
-    auto num_points = static_cast<int>(points.size());
-    for (int i = 0; const auto & p : points) {
-        xy_points_.emplace_back(std::make_unique<detail::CurveXYPointComponent>(i++));
-    }
-    for (int i = 0; i < num_points - 1; ++i) {
-        power_points_.emplace_back(std::make_unique<detail::CurvePowerPointComponent>(i));
-    }
-
-    for (const auto& xy : xy_points_)
-        addAndMakeVisible(xy.get());
-    for (const auto& power : power_points_)
-        addAndMakeVisible(power.get());
-
-    resized();
+    drag_ = Hit{};
+    hover_ = Hit{};
     repaint();
 }
+
 void CommonCurveEditor::OnPointXyChanged(CurveV2* generator, int changed_idx) {
-    if (IsFirstXyPoint(changed_idx)) {
-        SetXyPointPos(changed_idx);
-        SetPowerPointPos(changed_idx);
-    }
-    else if (IsLastXyPoint(changed_idx)) {
-        SetXyPointPos(changed_idx);
-        SetPowerPointPos(changed_idx - 1);
-    }
-    else {
-        SetXyPointPos(changed_idx);
-        SetPowerPointPos(changed_idx - 1);
-        SetPowerPointPos(changed_idx);
-    }
     repaint();
 }
 
 void CommonCurveEditor::OnPointPowerChanged(CurveV2* generator, int changed_idx) {
-    SetXyPointPos(changed_idx);
-    SetXyPointPos(changed_idx + 1);
-    SetPowerPointPos(changed_idx);
     repaint();
 }
 }
\ No newline at end of file
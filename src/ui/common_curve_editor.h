@@ -4,51 +4,11 @@
 #include "dsp/curve_v2.h"
 
 namespace mana {
-class CommonCurveEditor;
-}
-
-namespace mana::detail { // why did the pimpl broken on my computer?
-class CurvePowerPointComponent;
-class CurveXYPointComponent;
-
-class CurveXYPointComponent
-    : public juce::Component {
-public:
-    CurveXYPointComponent(int idx);
-
-    void paint(juce::Graphics& g) override;
-
-    void mouseDown(const juce::MouseEvent& e) override;
-    void mouseDrag(const juce::MouseEvent& e) override;
-    void mouseEnter(const juce::MouseEvent& e) override { repaint(); }
-    void mouseExit(const juce::MouseEvent& e) override { repaint(); }
-    void mouseDoubleClick(const juce::MouseEvent& e) override;
-private:
-    friend class CommonCurveEditor;
-    int idx_;
-    std::unique_ptr<juce::PopupMenu> popup_menu_;
-};
-
-class CurvePowerPointComponent
-    : public juce::Component {
-public:
-    CurvePowerPointComponent(int idx);
-
-    void paint(juce::Graphics& g) override;
-
-    void mouseDown(const juce::MouseEvent& e) override;
-    void mouseDrag(const juce::MouseEvent& e) override;
-    void mouseEnter(const juce::MouseEvent& /*e*/) override { repaint(); }
-    void mouseExit(const juce::MouseEvent& /*e*/) override { repaint(); }
-    void mouseDoubleClick(const juce::MouseEvent& e) override;
-private:
-    friend class CommonCurveEditor;
-    int idx_;
-    float last_power_{};
-};
-}
-
-namespace mana {
+/*
+* draws the curve and its points and hit-tests them itself, no component per point.
+* the points are sorted by x, so finding the one under the mouse only looks at the few
+* around it and a curve of thousands of points stays interactive
+*/
 class CommonCurveEditor
     : public juce::Component
     , public CurveV2::Listener {
@@ -56,7 +16,6 @@ public:
     ~CommonCurveEditor() override;
 
     void paint(juce::Graphics& g) override;
-    void resized() override;
 
     void SetCurve(CurveV2* new_curve);
     void SetSnapGrid(bool snap) { snap_grid_ = snap; }
@@ -64,30 +23,53 @@ public:
     void SetGridNum(int x, int y) { x_grid_ = x; y_grid_ = y; repaint(); }
     juce::Rectangle<int> GetComponentBounds() const;
 private:
+    enum class HitType {
+        kNone,
+        kXy,
+        kPower
+    };
+
+    struct Hit {
+        HitType type{ HitType::kNone };
+        int idx{};
+
+        bool operator==(const Hit&) const = default;
+    };
+
     bool snap_grid_{ false };
     bool display_grid_{ true };
     int x_grid_{ 8 };
     int y_grid_{ 1 };
 
+    void mouseMove(const juce::MouseEvent& e) override;
+    void mouseExit(const juce::MouseEvent& e) override;
+    void mouseDown(const juce::MouseEvent& e) override;
+    void mouseDrag(const juce::MouseEvent& e) override;
+    void mouseUp(const juce::MouseEvent& e) override;
     void mouseDoubleClick(const juce::MouseEvent& e) override;
 
-    friend class ::mana::detail::CurveXYPointComponent;
-    friend class ::mana::detail::CurvePowerPointComponent;
-
-    void DragXyPoint(detail::CurveXYPointComponent& p, const juce::MouseEvent& e);
-    void SetXyPointPos(detail::CurveXYPointComponent& p);
-    void SetXyPointPos(int idx) { SetXyPointPos(*xy_points_[idx]); }
-    void RemoveXyPoint(detail::CurveXYPointComponent& p);
+    // point or power handle under pos, the nearest when they overlap
+    Hit HitTest(juce::Point<float> pos) const;
+    void SetHover(Hit hover);
+    juce::Point<float> GetXyPointPos(int idx) const;
+    juce::Point<float> GetPowerPointPos(int idx) const;
+    // a segment too short or flat to grab has no power handle
+    bool HasPowerPoint(int idx) const;
+    void PaintPoints(juce::Graphics& g) const;
+
+    void DragXyPoint(int idx, const juce::MouseEvent& e);
+    // a drag is one curve edit, each move is committed so it is heard while dragging
+    void EndDragEdit();
+    void ShowPointMenu(int idx);
     bool IsFirstXyPoint(int idx) const { return idx == 0; }
-    bool IsLastXyPoint(int idx) const { return idx == static_cast<int>(xy_points_.size() - 1); }
-
-    void SetPowerPointPos(detail::CurvePowerPointComponent& p);
-    void SetPowerPointPos(int idx) { SetPowerPointPos(*power_points_[idx]); }
-
+    bool IsLastXyPoint(int idx) const { return idx == curve_->GetNumPoints() - 1; }
 
     CurveV2* curve_{};
-    std::vector<std::unique_ptr<detail::CurveXYPointComponent>> xy_points_;
-    std::vector<std::unique_ptr<detail::CurvePowerPointComponent>> power_points_;
+    Hit hover_;
+    Hit drag_;
+    bool editing_{ false };
+    float last_power_{};
+    std::unique_ptr<juce::PopupMenu> popup_menu_;
 
     // 通过 Listener 继承
     void OnAddPoint(CurveV2* generator, CurveV2::Point p, int before_idx) override;
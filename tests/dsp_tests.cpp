@@ -0,0 +1,315 @@
+/*
+* checks of the JUCE free dsp, every case is its own ctest test: sdelay_dsp_tests <case>
+*/
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <numbers>
+#include <random>
+#include <string_view>
+#include <vector>
+#include "dsp/stack_allpass.hpp"
+#include "dsp/partitioned_convolution.hpp"
+#include "dsp/delay_design.hpp"
+#include "dsp/allpass_bank.hpp"
+#include "dsp/sdelay.hpp"
+#include "dsp/convert.hpp"
+
+namespace {
+int g_num_failed = 0;
+
+void Check(bool ok, const char* what) {
+    if (!ok) {
+        std::printf("FAILED: %s\n", what);
+        ++g_num_failed;
+    }
+}
+
+std::vector<float> Noise(size_t length, unsigned seed) {
+    std::mt19937 rng{ seed };
+    std::uniform_real_distribution<float> u{ -0.5f, 0.5f };
+    std::vector<float> x(length);
+    for (auto& v : x) {
+        v = u(rng);
+    }
+    return x;
+}
+
+// a few points so an edit in the middle changes only part of the sections
+void AddPoints(mana::CurveV2& curve) {
+    for (int k = 1; k < 10; ++k) {
+        curve.AddPoint({ k / 10.0f, 0.2f + 0.05f * (k % 3) });
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+// the wavefront kernel, fused over several stacks with the rest one by one, against the serial one
+
+template<size_t N, class Arch>
+bool WavefrontMatchesSerial(int block_size) {
+    using Filter = StackAllPassFilter<N>;
+    // more stacks than any fuse count, so fused groups and the single stacks after them both run
+    constexpr size_t kNumStacks = 7;
+    constexpr int kLength = 2000;
+    std::mt19937 rng{ 1 };
+    std::uniform_real_distribution<float> u{ 0.0f, 1.0f };
+    typename Filter::template Arena<Filter> filters(kNumStacks);
+    for (auto& f : filters) {
+        float theta[N];
+        float radius[N];
+        for (size_t i = 0; i < N; ++i) {
+            theta[i] = u(rng) * 3.0f;
+            radius[i] = 0.5f + 0.49f * u(rng);
+        }
+        f.Set(theta, radius);
+    }
+
+    typename Filter::template Arena<typename Filter::State> serial_states(kNumStacks);
+    typename Filter::template Arena<typename Filter::State> wavefront_states(kNumStacks);
+    auto serial = Noise(kLength, 2);
+    auto wavefront = serial;
+    for (int n = 0; n < kLength; n += block_size) {
+        auto num = std::min(block_size, kLength - n);
+        Filter::template ProcessBlock<Arch>(filters.data(), serial_states.data(), kNumStacks, serial.data() + n, num);
+        Filter::template ProcessBlockWavefront<Arch>(filters.data(), wavefront_states.data(), kNumStacks, wavefront.data() + n, num);
+    }
+    return std::memcmp(serial.data(), wavefront.data(), kLength * sizeof(float)) == 0
+        && std::memcmp(serial_states.data(), wavefront_states.data(), kNumStacks * sizeof(typename Filter::State)) == 0;
+}
+
+template<class Arch>
+void CheckKernels(const char* name) {
+    for (int block_size : { 1, 3, 17, 64, 100, 513 }) {
+        char what[64];
+        std::snprintf(what, sizeof(what), "%s wavefront == serial, block %d", name, block_size);
+        Check(WavefrontMatchesSerial<4, Arch>(block_size), what);
+        Check(WavefrontMatchesSerial<8, Arch>(block_size), what);
+        Check(WavefrontMatchesSerial<16, Arch>(block_size), what);
+        Check(WavefrontMatchesSerial<32, Arch>(block_size), what);
+    }
+}
+
+void TestKernels() {
+    const auto available = xsimd::available_architectures();
+    if (available.sse2) {
+        CheckKernels<xsimd::sse2>("sse2");
+    }
+    if (available.avx2) {
+        CheckKernels<xsimd::avx2>("avx2");
+    }
+    if (available.avx512f) {
+        CheckKernels<xsimd::avx512f>("avx512f");
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+
+void TestConvolution() {
+    for (size_t ir_length : { size_t{ 1 }, size_t{ 200 }, size_t{ 256 }, size_t{ 257 }, size_t{ 3000 } }) {
+        auto ir = Noise(ir_length, 3);
+        auto x = Noise(5000, 4);
+        std::vector<double> direct(x.size());
+        for (size_t n = 0; n < x.size(); ++n) {
+            for (size_t k = 0; k < ir_length && k <= n; ++k) {
+                direct[n] += static_cast<double>(ir[k]) * x[n - k];
+            }
+        }
+
+        PartitionedConvolution conv;
+        conv.Init(PartitionedConvolution::kDefaultBlockSize);
+        conv.SetImpulseResponse(ir.data(), ir.size());
+        size_t offset = 0;
+        for (int num : { 1, 100, 255, 256, 257, 1000, 3131 }) {
+            num = static_cast<int>(std::min<size_t>(num, x.size() - offset));
+            conv.Process(x.data() + offset, num);
+            offset += num;
+        }
+
+        double max_error = 0.0;
+        double peak = 0.0;
+        for (size_t n = 0; n < x.size(); ++n) {
+            max_error = std::max(max_error, std::abs(x[n] - direct[n]));
+            peak = std::max(peak, std::abs(direct[n]));
+        }
+        char what[64];
+        std::snprintf(what, sizeof(what), "partitioned == direct, ir %zu", ir_length);
+        Check(offset == x.size() && max_error <= 1e-5 * std::max(1.0, peak), what);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+
+double GetPhase(const DelayDesign& design, float w) {
+    double phase = 0.0;
+    for (size_t k = 0; k < design.GetNumSections(); ++k) {
+        phase += AllPassSectionPhase(w, design.GetCenter(k), design.GetRadius(k));
+    }
+    return phase;
+}
+
+void TestRedesign() {
+    constexpr auto twopi = std::numbers::pi_v<double> * 2;
+    mana::CurveV2 curve{ 1024, mana::CurveV2::CurveInitEnum::kRamp };
+    AddPoints(curve);
+    for (bool pitch_axis : { true, false }) {
+        for (float dy : { 0.05f, -0.1f, 0.3f }) {
+            auto design = [&](DelayDesign& d) {
+                if (pitch_axis) {
+                    d.SetCurvePitchAxis(*curve.GetSnapshot(), 8192, 400.0f, 0.0f, 1.0f);
+                }
+                else {
+                    d.SetCurve(*curve.GetSnapshot(), 8192, 400.0f, 0.001f, 3.0f);
+                }
+            };
+            DelayDesign incremental;
+            incremental.SetBeta(0.9f);
+            design(incremental);
+            const auto y = curve.GetPoint(5).y;
+            curve.SetXy(5, curve.GetPoint(5).x, y + dy);
+            design(incremental);
+            DelayDesign full;
+            full.SetBeta(0.9f);
+            design(full);
+
+            // sections end on whole turns, the two can be apart by up to one of them anywhere
+            double max_error = 0.0;
+            for (int i = 1; i < 2000; ++i) {
+                auto w = std::numbers::pi_v<float> * i / 2000.0f;
+                max_error = std::max(max_error, std::abs(GetPhase(incremental, w) - GetPhase(full, w)));
+            }
+            Check(!incremental.IsFullDesign(), "an edit of the curve only redesigns around it");
+            Check(max_error <= 2.0 * twopi, "redesigned run == full design within two turns of phase");
+            curve.SetXy(5, curve.GetPoint(5).x, y);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+// DesignFrom finds where each section ends with a binary search over the phase prefix, the
+// linear axis is rebuilt here with the step by step scan it replaced
+
+void TestFindCrossing() {
+    constexpr auto twopi = std::numbers::pi_v<double> * 2;
+    constexpr int kResolution = 4096;
+    constexpr float kMaxDelayMs = 300.0f;
+    constexpr float kSampleRate = 48000.0f;
+    constexpr float kBegin = 0.001f;
+    constexpr float kEnd = 3.0f;
+    mana::CurveV2 curve{ 1024, mana::CurveV2::CurveInitEnum::kRamp };
+    AddPoints(curve);
+    const auto snapshot = curve.GetSnapshot();
+
+    DelayDesign design;
+    design.SetSampleRate(kSampleRate);
+    design.SetBulkDelay(0.0f);
+    design.SetCurve(*snapshot, kResolution, kMaxDelayMs, kBegin, kEnd);
+
+    const auto freq_interval = (kEnd - kBegin) / kResolution;
+    const auto scale = freq_interval * kSampleRate / 1000.0f;
+    std::vector<double> phase(kResolution + 1);
+    for (int i = 0; i < kResolution; ++i) {
+        auto step = std::max(0.0f, snapshot->GetNormalize(i / (kResolution - 1.0f)) * kMaxDelayMs * scale);
+        phase[i + 1] = phase[i] + step;
+    }
+
+    std::vector<float> centers;
+    size_t search_begin = 0;
+    size_t section_begin = 0;
+    double next = twopi;
+    while (search_begin < kResolution) {
+        auto end_step = search_begin + 1;
+        while (end_step <= kResolution && phase[end_step] < next) {
+            ++end_step;
+        }
+        end_step = std::min<size_t>(end_step, kResolution);
+        next = (std::floor(phase[end_step] / twopi) + 1) * twopi;
+        search_begin = end_step;
+
+        auto freq_begin = kBegin + section_begin * freq_interval;
+        auto freq_end = end_step >= kResolution ? kEnd : kBegin + end_step * freq_interval;
+        auto bw = freq_end - freq_begin;
+        if (bw > 0.0f) {
+            centers.push_back(freq_begin + bw / 2.0f);
+            section_begin = end_step;
+        }
+    }
+
+    bool same = centers.size() == design.GetNumSections();
+    for (size_t k = 0; same && k < centers.size(); ++k) {
+        same = centers[k] == design.GetCenter(k);
+    }
+    Check(same, "binary search sections == linear scan sections");
+}
+
+// ---------------------------------------------------------------------------------------------
+
+void TestDesign48k() {
+    constexpr float kSampleRate = 48000.0f;
+    constexpr float kDelayMs = 200.0f;
+    constexpr auto twopi = std::numbers::pi_v<float> * 2;
+    constexpr int kNumGrid = 256;
+    std::vector<float> grid(kNumGrid);
+    for (int i = 0; i < kNumGrid; ++i) {
+        grid[i] = SemitoneMap(i / static_cast<float>(kNumGrid)) / kSampleRate * twopi;
+    }
+
+    mana::CurveV2 curve{ 1024, mana::CurveV2::CurveInitEnum::kRamp };
+    AddPoints(curve);
+    DelayDesign design;
+    design.SetSampleRate(kSampleRate);
+    design.SetAnalysisGrid(grid);
+    design.SetMinBw(1.0f);
+    design.SetCurvePitchAxis(*curve.GetSnapshot(), 2048, kDelayMs, 0.0f, 1.0f);
+    Check(design.GetNumSections() > 0, "48 kHz design has sections");
+
+    SDelay delay;
+    delay.PrepareProcess(kSampleRate, kDelayMs);
+    const auto bank = delay.SetDesign(design);
+    // the analysis the summary shows is the group delay the bank runs, with the copies of the
+    // last section that fill its last stack
+    const auto num_sections = design.GetNumSections();
+    const auto num_padding = bank->GetNumFilters() - num_sections;
+    double max_error = 0.0;
+    for (int i = 0; i < kNumGrid; i += 16) {
+        double expected = design.GetAnalysisGroupDelay(i) + bank->GetBulkDelay()
+            + num_padding * design.GetSectionGroupDelay(num_sections - 1, grid[i]);
+        max_error = std::max(max_error, std::abs(bank->GetGroupDelay(grid[i]) - expected) / std::max(1.0, expected));
+    }
+    Check(max_error < 1e-3, "48 kHz analysis group delay == bank group delay");
+
+    auto x = Noise(20000, 5);
+    delay.Process(x.data(), static_cast<int>(x.size()));
+    bool finite = true;
+    for (auto v : x) {
+        finite = finite && std::isfinite(v);
+    }
+    Check(finite, "48 kHz design runs");
+}
+}
+
+int main(int argc, char** argv) {
+    struct Case {
+        std::string_view name;
+        void(*run)();
+    };
+    constexpr Case kCases[] = {
+        { "kernels", TestKernels },
+        { "convolution", TestConvolution },
+        { "redesign", TestRedesign },
+        { "find_crossing", TestFindCrossing },
+        { "design_48k", TestDesign48k },
+    };
+
+    bool found = false;
+    for (const auto& c : kCases) {
+        if (argc < 2 || c.name == argv[1]) {
+            c.run();
+            found = true;
+        }
+    }
+    if (!found) {
+        std::printf("unknown case %s\n", argv[1]);
+        return 1;
+    }
+    return g_num_failed == 0 ? 0 : 1;
+}